@@ -0,0 +1,188 @@
+#ifndef BINARYPROTO_H
+#define BINARYPROTO_H
+
+/*
+server和client公共的二进制聊天消息协议
+一对一聊天和群聊消息的字段是固定的, 客户端在LOGIN_MSG中携带 "binary": true 协商成功后,
+这两种消息可以不再经过json的序列化/反序列化, 直接按下面的格式编解码(多字节整数均为网络字节序):
+
+| magic(1) | version(1) | msgId(2) | fromid(4) | toid(4) | groupid(4) | time(8) | namelen(2) | reserved(2) |
+| name(namelen字节) | msg(剩余的所有字节, 原始UTF-8内容) |
+
+json消息体总以'{'开头, 与magic不会冲突, 因此同一个连接上两种格式可以混合收发
+*/
+
+#include <string>
+#include <ctime>
+#include <cstdint>
+#include "json.hpp"
+#include "public.hpp"
+using namespace std;
+using json = nlohmann::json;
+
+const uint8_t BINARY_MSG_MAGIC = 0xB1;  // 二进制消息的首字节标识
+const uint8_t BINARY_MSG_VERSION = 1;   // 二进制协议版本号
+const size_t BINARY_MSG_HEADER_LEN = 28; // 固定头部的长度
+const size_t BINARY_MSG_MAX_NAME_LEN = 0xFFFF; // namelen字段只有2字节, 用户名的最大字节数
+
+// 聊天消息(ONE_CHAT_MSG / GROUP_CHAT_MSG)解码后的统一表示
+struct ChatMessage
+{
+    int msgId = 0;    // 消息类型
+    int fromid = 0;   // 发送者id, 对应json中的"id"
+    int toid = 0;     // 一对一聊天的接收者id
+    int groupid = 0;  // 群聊的群组id
+    int64_t time = 0; // 发送时间(秒级时间戳)
+    string name;      // 发送者用户名
+    string msg;       // 聊天内容
+};
+
+inline void binaryPutInt(string &out, uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i)
+    {
+        out.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+}
+
+inline uint64_t binaryGetInt(const string &in, size_t offset, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+        value = (value << 8) | static_cast<uint8_t>(in[offset + i]);
+    }
+    return value;
+}
+
+// 判断一个消息帧是否是二进制格式的聊天消息
+inline bool isBinaryMsg(const string &frame)
+{
+    return !frame.empty() && static_cast<uint8_t>(frame[0]) == BINARY_MSG_MAGIC;
+}
+
+// 将聊天消息编码成二进制格式, 用户名超过BINARY_MSG_MAX_NAME_LEN时无法编码, 返回空串, 调用者改用json格式
+// (合法的二进制消息至少有固定头部, 不会是空串)
+inline string encodeBinaryMsg(const ChatMessage &m)
+{
+    string out;
+    if (m.name.size() > BINARY_MSG_MAX_NAME_LEN)
+    {
+        return out;
+    }
+    out.reserve(BINARY_MSG_HEADER_LEN + m.name.size() + m.msg.size());
+    binaryPutInt(out, BINARY_MSG_MAGIC, 1);
+    binaryPutInt(out, BINARY_MSG_VERSION, 1);
+    binaryPutInt(out, static_cast<uint16_t>(m.msgId), 2);
+    binaryPutInt(out, static_cast<uint32_t>(m.fromid), 4);
+    binaryPutInt(out, static_cast<uint32_t>(m.toid), 4);
+    binaryPutInt(out, static_cast<uint32_t>(m.groupid), 4);
+    binaryPutInt(out, static_cast<uint64_t>(m.time), 8);
+    binaryPutInt(out, static_cast<uint16_t>(m.name.size()), 2);
+    binaryPutInt(out, 0, 2); // reserved
+    out.append(m.name);
+    out.append(m.msg);
+    return out;
+}
+
+// 解码二进制格式的聊天消息, 格式不合法返回false
+inline bool decodeBinaryMsg(const string &frame, ChatMessage &m)
+{
+    if (frame.size() < BINARY_MSG_HEADER_LEN || !isBinaryMsg(frame) || static_cast<uint8_t>(frame[1]) != BINARY_MSG_VERSION)
+    {
+        return false;
+    }
+
+    size_t namelen = binaryGetInt(frame, 24, 2);
+    if (frame.size() < BINARY_MSG_HEADER_LEN + namelen)
+    {
+        return false;
+    }
+
+    m.msgId = static_cast<uint16_t>(binaryGetInt(frame, 2, 2));
+    m.fromid = static_cast<int32_t>(binaryGetInt(frame, 4, 4));
+    m.toid = static_cast<int32_t>(binaryGetInt(frame, 8, 4));
+    m.groupid = static_cast<int32_t>(binaryGetInt(frame, 12, 4));
+    m.time = static_cast<int64_t>(binaryGetInt(frame, 16, 8));
+    m.name.assign(frame, BINARY_MSG_HEADER_LEN, namelen);
+    m.msg.assign(frame, BINARY_MSG_HEADER_LEN + namelen, string::npos);
+    return true;
+}
+
+// 秒级时间戳 => json消息中"time"字段使用的 "YYYY-MM-DD hh:mm:ss" 格式
+inline string formatChatTime(int64_t t)
+{
+    time_t tt = static_cast<time_t>(t);
+    struct tm tmv;
+    localtime_r(&tt, &tmv);
+    char date[60] = {0};
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tmv);
+    return date;
+}
+
+// json消息中"time"字段 => 秒级时间戳, 解析失败返回0
+inline int64_t parseChatTime(const string &s)
+{
+    struct tm tmv = {};
+    if (strptime(s.c_str(), "%Y-%m-%d %H:%M:%S", &tmv) == nullptr)
+    {
+        return 0;
+    }
+    tmv.tm_isdst = -1;
+    return static_cast<int64_t>(mktime(&tmv));
+}
+
+// 读取json中的整数字段, 字段不存在或类型不对时返回0, 不抛出异常
+inline int64_t chatJsonInt(const json &js, const char *key)
+{
+    auto it = js.find(key);
+    return it != js.end() && it->is_number_integer() ? it->get<int64_t>() : 0;
+}
+
+// 读取json中的字符串字段, 字段不存在或类型不对时返回空串, 不抛出异常
+inline string chatJsonString(const json &js, const char *key)
+{
+    auto it = js.find(key);
+    return it != js.end() && it->is_string() ? it->get<string>() : string();
+}
+
+// json格式的聊天消息 => ChatMessage
+// json来自其它客户端或其它服务器, 字段类型不可信, 类型不对的字段按缺失处理, 不会抛出异常
+inline ChatMessage chatMessageFromJson(const json &js)
+{
+    ChatMessage m;
+    if (!js.is_object())
+    {
+        return m;
+    }
+    m.msgId = static_cast<int>(chatJsonInt(js, "msgId"));
+    m.fromid = static_cast<int>(chatJsonInt(js, "id"));
+    m.toid = static_cast<int>(chatJsonInt(js, "toid"));
+    m.groupid = static_cast<int>(chatJsonInt(js, "groupid"));
+    m.time = parseChatTime(chatJsonString(js, "time"));
+    m.name = chatJsonString(js, "name");
+    m.msg = chatJsonString(js, "msg");
+    return m;
+}
+
+// ChatMessage => json格式的聊天消息, 字段与客户端发送的json消息保持一致
+inline json chatMessageToJson(const ChatMessage &m)
+{
+    json js;
+    js["msgId"] = m.msgId;
+    js["id"] = m.fromid;
+    js["name"] = m.name;
+    if (m.msgId == GROUP_CHAT_MSG)
+    {
+        js["groupid"] = m.groupid;
+    }
+    else
+    {
+        js["toid"] = m.toid;
+    }
+    js["msg"] = m.msg;
+    js["time"] = formatChatTime(m.time);
+    return js;
+}
+
+#endif
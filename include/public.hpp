@@ -1,7 +1,13 @@
 #ifndef PUBLIC_H
 #define PUBLIC_H
 
-/* server和client的公共文件 */
+/*
+server和client的公共文件
+请求中可以携带整数字段reqId, 服务器在对应的_ACK中原样回填,
+客户端可以在一个连接上连续发出多个请求而不必逐个等待, 再按reqId匹配先后完成的响应
+离线消息分批下发: LOGIN_MSG_ACK中的offlinemsg是第一批, offlineLastId是这一批最后一条消息的id,
+客户端处理完后回复OFFLINE_MSG_ACK(lastId), 服务器删除lastId及之前的消息, 再用OFFLINE_MSG发送下一批, 直到more为false
+*/
 enum EnMsgType
 {
     LOGIN_MSG = 1,  // 登录消息
@@ -15,6 +21,13 @@ enum EnMsgType
     CREATE_GROUP_MSG, // 创建群组消息
     ADD_GROUP_MSG,    // 加入群组消息
     GROUP_CHAT_MSG,   // 群组聊天消息
+
+    HEARTBEAT_MSG, // 心跳消息, 客户端空闲时定期发送, 防止连接被服务器当作失联连接关闭
+    SERVER_BUSY_MSG, // 服务器繁忙, 新连接超出准入预算, 客户端应在retryAfter毫秒后重新连接
+    OFFLINE_MSG,     // 一批离线消息 msgs lastId more
+    OFFLINE_MSG_ACK, // 客户端确认已收到lastId及之前的所有离线消息
+
+    MSG_TYPE_END, // 消息类型id的上界, 不是实际的消息, 新的消息类型加在它前面
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,84 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include "config.hpp"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+// 令牌桶, 以rate个/秒的速度补充令牌, 最多积攒burst个, rate为0表示不限制
+class TokenBucket
+{
+public:
+    TokenBucket(double rate = 0, double burst = 0);
+
+    // 先按流逝的时间补充令牌, 有令牌时返回0, 否则返回攒够一个令牌还需要等待的秒数
+    double wait(double now);
+
+    // 取走一个令牌, 调用前wait必须返回0
+    void take();
+
+    // 令牌是否已经补满(长时间没有请求)
+    bool full(double now);
+
+private:
+    double _rate;
+    double _burst;
+    double _tokens;
+    double _last; // 上次补充令牌的时间(秒)
+};
+
+/*
+准入控制, 所有acceptor和IO线程共享的单例
+节点重启后所有客户端会同时重连并登录, 每次登录都要访问若干次MySQL, 不加限制时节点会被压垮
+新连接和登录请求各有一个全局令牌桶和按来源IP划分的令牌桶, 两个桶都有令牌才放行,
+超出预算的请求不排队, 而是立即告知客户端在一段时间之后重试
+记录的来源IP数有上限: 清理已补满的IP每个补满周期最多做一次, 表满且清理不出空位时新IP只检查全局令牌桶
+*/
+class AdmissionControl
+{
+public:
+    // 获取单例对象的接口函数
+    static AdmissionControl *instance();
+
+    // 按配置设置各个令牌桶的速率并清空记录的来源IP, 在服务器启动前调用
+    void configure(const ServerConfig &config);
+
+    // 新连接的准入检查, 放行返回0, 否则返回建议客户端重试前等待的毫秒数
+    int admitConnection(const string &ip) { return admitConnection(ip, now()); }
+    int admitConnection(const string &ip, double now);
+
+    // 登录请求的准入检查, 返回值同admitConnection
+    int admitLogin(const string &ip) { return admitLogin(ip, now()); }
+    int admitLogin(const string &ip, double now);
+
+    // 当前时间(秒), now参数用于测试时模拟时间的流逝
+    static double now();
+
+private:
+    AdmissionControl() = default;
+
+    // 一类请求的限流器: 全局令牌桶 + 每个来源IP的令牌桶
+    struct Limiter
+    {
+        mutex mtx;
+        TokenBucket global;
+        double ipRate = 0;
+        double ipBurst = 0;
+        double sweepInterval = 1; // 两次清理之间的最短间隔(秒), 取令牌桶从空到补满的时间
+        double lastSweep = 0;     // 上次清理的时间(秒)
+        unordered_map<string, TokenBucket> perIp;
+    };
+
+    // 设置一类请求的令牌桶速率并清空记录的来源IP
+    static void configure(Limiter &limiter, double rate, double ipRate);
+
+    // 对一类请求做准入检查
+    int admit(Limiter &limiter, const string &ip, double now);
+
+    Limiter _connections;
+    Limiter _logins;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef CHATCODEC_H
+#define CHATCODEC_H
+
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/EventLoop.h>
+#include <functional>
+#include <string>
+#include <memory>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 一个完整的消息帧(不含长度头), 从接收缓冲区中取出后不可修改, 转发时多处共享同一份数据
+using FramePtr = shared_ptr<const string>;
+
+/*
+消息帧的编解码器, 解决TCP粘包/半包问题
+帧格式: | 4字节长度头(网络字节序) | len字节的消息体 |
+一次onMessage可能收到多个完整帧,也可能只收到半个帧,编解码器会循环取出所有完整的帧,
+剩下不完整的数据留在muduo的Buffer中等待下次数据到达
+*/
+class ChatCodec
+{
+public:
+    // 收到一个完整消息帧后的回调, frame是去掉长度头之后的消息体
+    using FrameCallback = function<void(const TcpConnectionPtr &, const FramePtr &frame, Timestamp)>;
+
+    static const size_t kHeaderLen = sizeof(int32_t); // 长度头的字节数
+    static const size_t kMaxFrameLen = 4 * 1024 * 1024; // 默认单帧最大长度4MB
+
+    // 从buffer中取出一个帧的结果
+    enum DecodeResult
+    {
+        kFrameReady,      // 取出了一个完整的帧
+        kFrameIncomplete, // 半包, 数据留在buffer中等待下次到达
+        kFrameInvalid,    // 长度非法, 之后的数据已无法正确分帧
+    };
+
+    explicit ChatCodec(const FrameCallback &cb, size_t maxFrameLen = kMaxFrameLen);
+
+    // 设置单帧最大长度,超过该长度的帧视为非法数据,直接断开连接
+    void setMaxFrameLen(size_t maxFrameLen) { _maxFrameLen = maxFrameLen; }
+
+    // 注册到TcpServer的消息回调, 从buffer中循环解析出所有完整的消息帧
+    void onMessage(const TcpConnectionPtr &con, Buffer *buffer, Timestamp time);
+
+    // 从buffer中取出一个完整的帧放入frame, 不依赖连接, 可以单独测试
+    static DecodeResult decode(Buffer *buffer, size_t maxFrameLen, FramePtr &frame);
+
+    // 给消息加上长度头后写入buffer
+    static void encode(const string &message, Buffer *buffer);
+
+    // 给消息加上长度头后发送, 与聊天消息一样经投递聚合器发送, 同一个连接上的响应和聊天消息按调用的先后顺序到达
+    static void send(const TcpConnectionPtr &con, const string &message);
+
+    // 发送共享的消息帧, 经连接所在EventLoop的投递聚合器合并发送
+    // 跨线程发送时只传递引用计数, 到连接所在的IO线程中才拷贝进发送缓冲区
+    static void send(const TcpConnectionPtr &con, const FramePtr &message);
+
+    // 不经过投递聚合器, 立即交给TcpConnection::send, 只用于之后马上要关闭的、没有其它待发送消息的连接:
+    // shutdown在连接所在的IO线程中立即生效, 之后才flush的消息会被丢弃
+    static void sendNow(const TcpConnectionPtr &con, const string &message);
+
+private:
+    FrameCallback _frameCallback; // 上报完整消息帧的回调
+    size_t _maxFrameLen;          // 单帧最大长度
+};
+
+#endif
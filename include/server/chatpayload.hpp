@@ -0,0 +1,52 @@
+#ifndef CHATPAYLOAD_H
+#define CHATPAYLOAD_H
+
+#include <muduo/net/TcpConnection.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "chatcodec.hpp"
+#include "binaryproto.hpp"
+using namespace std;
+using namespace muduo::net;
+
+/*
+一条待转发的聊天消息, 创建后不可修改, 通过ChatPayloadPtr在一对一/群聊的所有投递路径
+(本地连接发送、redis发布、离线消息存储)之间共享, 无论群组有多少成员都不会重复编码和拷贝
+- 消息来自客户端时直接引用收到的原始帧, 与来源格式相同的接收方转发的就是原始字节
+- 另一种格式在第一次被需要时才编码, 每种格式最多编码一次, 多线程并发访问也是安全的
+*/
+class ChatPayload
+{
+public:
+    // 来自json格式的原始帧, 或redis通道上收到的json消息
+    explicit ChatPayload(const FramePtr &jsonFrame);
+
+    // 来自二进制格式的原始帧, msg是该帧解码后的消息字段
+    ChatPayload(const ChatMessage &msg, const FramePtr &binaryFrame);
+
+    ChatPayload(const ChatPayload &) = delete;
+    ChatPayload &operator=(const ChatPayload &) = delete;
+
+    // json格式的消息内容, 用于json客户端、redis跨服务器转发和离线消息存储
+    const FramePtr &jsonFrame() const;
+
+    // 二进制格式的消息内容, 用于协商了二进制协议的客户端
+    // json来源的消息无法解析时返回空指针, 调用者丢弃该消息; 用户名过长无法按二进制编码时返回json格式
+    const FramePtr &binaryFrame() const;
+
+    // 按接收方连接协商的协议选择消息格式, 可能返回空指针(见binaryFrame)
+    const FramePtr &frameFor(const TcpConnectionPtr &con) const;
+
+private:
+    // 以下成员是惰性编码的缓存, 由once_flag保证只初始化一次, 初始化后不再修改
+    mutable ChatMessage _msg;   // 解码后的消息字段, 二进制来源的消息或已经转换过时有效
+    mutable FramePtr _json;     // json格式的消息内容
+    mutable FramePtr _binary;   // 二进制格式的消息内容
+    mutable once_flag _jsonOnce;
+    mutable once_flag _binaryOnce;
+};
+
+using ChatPayloadPtr = shared_ptr<const ChatPayload>;
+
+#endif
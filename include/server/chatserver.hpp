@@ -3,6 +3,11 @@
 
 #include <muduo/net/TcpServer.h>
 #include <muduo/net/EventLoop.h>
+#include "chatcodec.hpp"
+#include "config.hpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
 using namespace muduo;
 using namespace muduo::net;
 
@@ -11,22 +16,45 @@ class ChatServer
 {
 public:
     // 初始化聊天服务器对象
+    // 配置了多个acceptor时, 每个acceptor对应一个ChatServer对象, acceptorIndex为其编号,
+    // 它们以SO_REUSEPORT监听同一个端口, 由内核把新连接分散到各个acceptor上, 业务层ChatService是共享的
     ChatServer(EventLoop* loop,
             const InetAddress& listenAddr,
-            const string& nameArg);
+            const string& nameArg,
+            const ServerConfig& config = ServerConfig(),
+            int acceptorIndex = 0);
     
-    // 启动服务
+    // 启动服务, 必须在loop所在的线程中调用
     void start();
 private:
     TcpServer _server; // 组合的muduo库,实现服务器功能的类对象
     EventLoop *_loop; // 指向事件循环对象的指针
+    ChatCodec _codec; // 消息帧编解码器,负责从接收缓冲区中切分出完整的消息
+    ServerConfig _config; // 服务器配置(线程数、CPU绑定、监听队列长度、发送缓冲区预算等)
+    int _acceptorIndex;   // acceptor编号
+
+    atomic<int> _nextIoThread; // IO线程启动时依次分配的编号, 用于选择绑定的CPU
+    mutex _loopCpuMutex;
+    vector<pair<int, int>> _loopCpus; // 每个IO线程的 (编号, 绑定的CPU), 用于启动报告
+
+    // 输出IO线程与CPU的对应关系
+    void reportThreadLayout();
+
+    // IO线程启动时的初始化回调, 创建该线程EventLoop的私有状态
+    void onThreadInit(EventLoop *loop);
 
     // 上报链接相关信息的回调函数
     void onConnection(const TcpConnectionPtr&);
 
-    // 上报读写事件相关信息的回调函数
-    void onMessage(const TcpConnectionPtr &con, // 当前的连接
-                   Buffer *buffer,              // 接收到的数据缓冲区
-                   Timestamp time);              // 接收到数据的时间信息
+    // 连接的发送缓冲区超过预算的回调函数, 该连接进入限流状态
+    void onHighWaterMark(const TcpConnectionPtr &con, size_t len);
+
+    // 连接的发送缓冲区全部发送完毕的回调函数, 限流中的连接恢复正常投递
+    void onWriteComplete(const TcpConnectionPtr &con);
+
+    // 编解码器上报完整消息帧的回调函数
+    void onFrame(const TcpConnectionPtr &con, // 当前的连接
+                 const FramePtr &frame,       // 一个完整的消息帧(不含长度头)
+                 Timestamp time);             // 接收到数据的时间信息
 };
 #endif
\ No newline at end of file
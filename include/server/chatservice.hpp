@@ -4,7 +4,7 @@
 #include <muduo/net/TcpConnection.h>
 #include <unordered_map>
 #include <functional>
-#include <mutex>  // 添加互斥锁,保证容器_userConnMap的线程安全
+#include <array>
 using namespace std;
 using namespace muduo;
 using namespace muduo::net;
@@ -15,11 +15,27 @@ using namespace placeholders;
 #include "friendmodel.hpp"
 #include "groupmodel.hpp"
 #include "redis.hpp"
+#include "chatcodec.hpp"
+#include "chatpayload.hpp"
+#include "binaryproto.hpp"
+#include "msgrequest.hpp"
+#include "workerpool.hpp"
+#include "offlinemsgwriter.hpp"
+#include "coroutine.hpp"
+#include "userconnregistry.hpp"
+#include "sessionrouter.hpp"
+#include "session.hpp"
+#include "public.hpp"
 #include "json.hpp"
 using json = nlohmann::json;
 
-// 表示处理消息的事件回调方法类型
-using MsgHandler = std::function<void(const TcpConnectionPtr &con, json &js, Timestamp)>;
+class ChatService;
+
+// 消息分发函数类型: 把json解码成对应的请求类型后调用业务处理函数, frame是该消息的原始帧数据
+using MsgDispatcher = void (*)(ChatService *service, const TcpConnectionPtr &con, const json &js, const FramePtr &frame, Timestamp time);
+
+// 以消息id为下标的分发表, 在编译期生成, 没有处理函数的消息id为nullptr
+using MsgDispatchTable = array<MsgDispatcher, MSG_TYPE_END>;
 
 // 聊天服务器业务类 采用单例模式设计
 class ChatService
@@ -28,38 +44,56 @@ public:
     // 获取单例对象的接口函数
     static ChatService* instance();
 
-    // 处理登录业务
-    void login(const TcpConnectionPtr &con, json &js, Timestamp time);
+    // 启动业务线程池和同样大小的扇出线程池, numThreads为0时业务直接在IO线程中执行
+    void startWorkers(int numThreads);
+
+    // 启动离线消息的批量写入线程, 不启动时每条离线消息单独写入
+    void startOfflineWriter(int flushMs, size_t batchRows, size_t maxQueued);
+
+    // 在连接con对应的业务线程中执行task, 同一个用户的任务按提交顺序执行
+    void post(const TcpConnectionPtr &con, WorkerPool::Task task);
+
+    // 处理登录业务, 协程, 数据库和redis操作在业务线程中执行, 其余部分在连接所在的IO线程中执行
+    Task login(TcpConnectionPtr con, LoginRequest request, Timestamp time);
     
     // 处理注册业务
-    void reg(const TcpConnectionPtr &con, json &js, Timestamp time);
+    void reg(const TcpConnectionPtr &con, const RegRequest &request, Timestamp time);
 
-    // 一对一聊天业务
-    void oneChat(const TcpConnectionPtr &con, json &js, Timestamp time);
+    // 一对一聊天业务, 在IO线程中执行, 查询接收者在线状态等数据库操作交给业务线程, 不等待其结果
+    void oneChat(const TcpConnectionPtr &con, const OneChatRequest &request, Timestamp time);
 
     // 添加好友业务
-    void addFriend(const TcpConnectionPtr &con, json &js, Timestamp time);
+    void addFriend(const TcpConnectionPtr &con, const AddFriendRequest &request, Timestamp time);
 
     // 创建群组业务
-    void createGroup(const TcpConnectionPtr &con, json &js, Timestamp time);
+    void createGroup(const TcpConnectionPtr &con, const CreateGroupRequest &request, Timestamp time);
     
     // 加入群组业务
-    void addGroup(const TcpConnectionPtr &con, json &js, Timestamp time);
+    void addGroup(const TcpConnectionPtr &con, const AddGroupRequest &request, Timestamp time);
     
-    // 群组聊天业务
-    void groupChat(const TcpConnectionPtr &con, json &js, Timestamp time);
+    // 群组聊天业务, 协程
+    Task groupChat(TcpConnectionPtr con, GroupChatRequest request, Timestamp time);
+
+    // 处理二进制格式的聊天消息(一对一聊天/群聊)
+    void binaryChat(const TcpConnectionPtr &con, const ChatMessage &msg, const FramePtr &frame, Timestamp time);
 
     // 处理注销业务
-    void loginout(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void loginout(const TcpConnectionPtr &conn, const LoginoutRequest &request, Timestamp time);
     
     // 处理客户端异常退出
     void clientCloseException(const TcpConnectionPtr &con);
 
+    // 限流中的连接发送缓冲区已清空, 补发限流期间转存的离线消息并恢复正常投递
+    void resumeDelivery(const TcpConnectionPtr &con);
+
+    // 客户端确认收到了一批离线消息, 删除已确认的消息并发送下一批
+    void offlineAck(const TcpConnectionPtr &con, const OfflineAckRequest &request, Timestamp time);
+
     // 服务器异常中断,业务重置方法
     void reset();
 
-    // 获取消息id对应的Handler处理器
-    MsgHandler getHandler(int msgId);
+    // 按消息id分发消息到对应的业务处理函数
+    void dispatch(int msgId, const TcpConnectionPtr &con, const json &js, const FramePtr &frame, Timestamp time);
 
     // 从redis消息队列中获取订阅的消息
     void handleRedisSubscribeMessage(int userid, string msg);
@@ -67,14 +101,65 @@ public:
 private:
     ChatService(); // 单例模式需将构造函数私有化
 
-    // 存储消息id和其对应的业务处理方法
-    unordered_map<int, MsgHandler> _msgHandlerMap;
+    // 连接con对应的业务线程分片
+    size_t shardKey(const TcpConnectionPtr &con);
+
+    // co_await blocking(con, func): 在con对应的业务线程中执行阻塞调用func, 完成后回到con所在的IO线程继续执行
+    template <typename Func>
+    BlockingCall<Func> blocking(const TcpConnectionPtr &con, Func func)
+    {
+        return BlockingCall<Func>(_workers, shardKey(con), con->getLoop(), std::move(func));
+    }
+
+    // co_await parallel(con, funcs...): 同时执行一组互不依赖的阻塞调用, 全部完成后回到con所在的IO线程继续执行
+    // 第一个调用在con对应的业务线程中执行, 其余的在扇出线程池中执行, 只能做不依赖用户任务顺序的只读查询
+    template <typename... Funcs>
+    ParallelCall<Funcs...> parallel(const TcpConnectionPtr &con, Funcs... funcs)
+    {
+        return ParallelCall<Funcs...>(_workers, _fanout, shardKey(con), con->getLoop(), std::move(funcs)...);
+    }
+
+    // 登记用户userid在本服务器上的连接
+    void registerUser(int userid, const TcpConnectionPtr &con);
+
+    // 注销用户userid的连接, con不为空时只有登记的仍是con才注销
+    void unregisterUser(int userid, const TcpConnectionPtr &con);
 
-    // 存储在线用户的通信连接
-    unordered_map<int, TcpConnectionPtr> _userConnMap;
+    // 向一组用户中在本服务器上的用户投递消息, 其余用户id交给missing处理;
+    // 启用home_loops时在各用户的归属IO线程中查找并发送, missing可能在其它线程中调用
+    void deliverLocal(const vector<int> &userids, const ChatPayloadPtr &payload, SessionRouter::MissingCallback missing);
 
-    // 定义互斥锁,保证容器_userConnMap的线程安全
-    mutex _connMutex;
+    // 不在本服务器上的接收者: 在业务线程分片key中查询在线状态, 在线的经redis转发, 否则存为离线消息
+    void relayOrStore(size_t key, vector<int> &remoteIds, const ChatPayloadPtr &payload);
+
+    // 一批离线消息
+    struct OfflineBatch
+    {
+        json msgs = json::array(); // 消息列表
+        int64_t lastId = 0;        // 这一批最后一条消息的id, 没有消息时为0
+        bool more = false;         // 之后是否还有离线消息
+    };
+
+    // 读取用户userid的id大于afterId的一批离线消息, 在业务线程中调用
+    OfflineBatch loadOfflineBatch(int userid, int64_t afterId);
+
+    // 向连接con发送用户userid在已确认位置之后的一批离线消息, 并记录在会话中, 没有消息时不发送, 在该用户的业务线程中调用
+    void sendOfflineBatch(const TcpConnectionPtr &con, Session &session, int userid);
+
+    // 向本服务器上用户userid的连接con发送消息, 连接处于限流状态时转存为离线消息
+    void sendOrSpill(int userid, const TcpConnectionPtr &con, const ChatPayloadPtr &payload);
+
+    // 取出发给用户userid的连接con的消息帧, 连接处于限流状态时转存为离线消息并返回空, 可在任意线程调用
+    FramePtr frameOrSpill(int userid, const TcpConnectionPtr &con, const ChatPayloadPtr &payload);
+
+    // 向用户toid投递一对一聊天消息, con是发送者的连接
+    void deliverOneChat(const TcpConnectionPtr &con, int toid, const ChatPayloadPtr &payload);
+
+    // 向群组groupid中除userid之外的其他成员投递群聊消息, con是发送者的连接
+    Task deliverGroupChat(TcpConnectionPtr con, int userid, int groupid, ChatPayloadPtr payload);
+
+    // 存储在线用户的通信连接, 分段加锁, 内部保证线程安全; 启用home_loops时改用SessionRouter
+    UserConnRegistry _userConns;
 
     // 数据操作类对象
     UserModel _userModel;
@@ -84,6 +169,15 @@ private:
 
     // redis操作对象
     Redis _redis;
+
+    // 离线消息的批量写入器, 各业务线程存储离线消息都交给它合并写入
+    OfflineMsgWriter _offlineWriter;
+
+    // 业务线程池, 放在最后, 析构时先等待业务线程退出, 再析构它们用到的其他成员
+    WorkerPool _workers;
+
+    // 扇出线程池, 执行parallel中不需要按用户排序的调用, 不占用其他用户的业务线程
+    WorkerPool _fanout;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+/*
+服务器配置, 先读取配置文件, 再用命令行选项覆盖
+配置文件每行一个 key = value, '#'开头的行为注释, 支持的key:
+    ip, port                监听的地址和端口
+    io_threads              IO线程总数, 默认等于CPU核数, 多个acceptor时平均分给每个acceptor
+    io_cpus                 IO线程依次绑定的CPU列表, 如 "1-7" 或 "1,3,5", 为空表示不绑定
+    acceptors               acceptor的数量, 大于1时每个acceptor在自己的线程中以SO_REUSEPORT监听同一端口
+    acceptor_cpu            acceptor线程依次绑定的CPU列表, 格式同io_cpus, -1或为空表示不绑定
+    output_budget_kb        每个连接发送缓冲区的预算(KB), 超过后转存离线消息
+    home_loops              1表示每个用户固定归属一个IO线程, 在线用户表按IO线程划分且只由该线程访问, 投递路径上没有锁
+    worker_threads          业务线程数, 阻塞的MySQL、Redis调用在业务线程中执行, 0表示业务直接在IO线程中执行
+    idle_timeout            连接空闲(没有收到任何消息, 包括心跳)超过该秒数后被关闭, 0表示不检测
+    connect_rate            每秒最多接受的新连接数, 突发容量为其2倍, 0表示不限制
+    login_rate              每秒最多处理的登录请求数, 突发容量为其2倍, 0表示不限制
+    ip_rate                 每个来源IP每秒最多的新连接数和登录请求数(分别计算), 0表示不限制
+    db_host, db_port        MySQL主库的地址和端口, 所有写操作都在主库上执行
+    db_user, db_password    MySQL的账号和密码, 主库和从库相同
+    db_name                 数据库名
+    db_replicas             MySQL从库列表, 如 "10.0.0.2:3306,10.0.0.3", 只读操作分配到从库, 为空表示只用主库
+    db_max_replica_lag      从库的复制延迟超过该秒数时不再分配读请求
+    db_pool_min             MySQL连接池至少保持的连接数(主库和每个从库各一个连接池), 不能大于db_pool_max
+    db_pool_max             MySQL连接池最多的连接数, 必须大于0
+    db_idle_timeout         MySQL连接空闲超过该秒数后被关闭(至少保留db_pool_min个), 0表示不回收
+    db_wait_timeout_ms      连接都在使用中时, 取连接最多等待的毫秒数
+    offline_batch_ms        离线消息入队后最多等待该毫秒数就批量写入数据库
+    offline_batch_rows      离线消息累计到该条数时立即写入, 也是一条INSERT语句的最大行数
+    offline_queue_max       离线消息队列的最大长度, 队列满时业务线程等待写入
+    metrics_interval        运行指标输出到日志的时间间隔(秒)
+*/
+struct ServerConfig
+{
+    string ip = "127.0.0.1";
+    uint16_t port = 6000;
+    int ioThreads = 0;          // 0表示使用CPU核数
+    vector<int> ioCpus;         // IO线程依次绑定的CPU
+    int acceptors = 1;          // acceptor的数量
+    vector<int> acceptorCpus;   // acceptor线程依次绑定的CPU
+    size_t outputBudget = 4 * 1024 * 1024; // 每个连接发送缓冲区的预算(字节)
+    bool homeLoops = false;     // 是否按用户划分归属IO线程
+    int workerThreads = 8;      // 业务线程数
+    int idleTimeout = 120;      // 空闲连接超时时间(秒), 客户端每30秒发送一次心跳
+    double connectRate = 2000;  // 新连接的全局准入速率(个/秒)
+    double loginRate = 500;     // 登录请求的全局准入速率(个/秒)
+    double ipRate = 0;          // 每个来源IP的准入速率(个/秒), 0表示不按IP限流
+    string dbHost = "127.0.0.1"; // MySQL主库
+    uint16_t dbPort = 3306;
+    string dbUser = "root";
+    string dbPassword = "123456";
+    string dbName = "chat";
+    vector<pair<string, uint16_t>> dbReplicas; // MySQL从库的地址和端口
+    int dbMaxReplicaLag = 2;    // 从库允许的最大复制延迟(秒)
+    int dbPoolMin = 4;          // MySQL连接池的最小连接数
+    int dbPoolMax = 32;         // MySQL连接池的最大连接数
+    int dbIdleTimeout = 60;     // MySQL空闲连接的回收时间(秒)
+    int dbWaitTimeoutMs = 3000; // 取MySQL连接的最长等待时间(毫秒)
+    int offlineBatchMs = 10;    // 离线消息批量写入的最长等待时间(毫秒)
+    int offlineBatchRows = 500; // 离线消息批量写入的最大行数
+    int offlineQueueMax = 100000; // 离线消息队列的最大长度
+    double metricsInterval = 60.0; // 运行指标输出间隔(秒)
+
+    // 读取配置文件, 失败时返回false并在err中给出原因
+    bool loadFile(const string &path, string &err);
+
+    // 解析命令行: ./ChatServer [ip port] [--config file] [--threads N] ...
+    bool parseArgs(int argc, char **argv, string &err);
+
+    // 命令行用法说明
+    static string usage();
+
+    // IO线程总数的实际取值
+    int effectiveIoThreads() const;
+
+    // 每个acceptor分到的IO线程数量, 所有acceptor的IO线程总数等于effectiveIoThreads
+    int ioThreadsPerAcceptor() const;
+
+private:
+    // 设置一个配置项, key未知或value非法时返回false
+    bool set(const string &key, const string &value, string &err);
+};
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include "workerpool.hpp"
+#include <muduo/net/EventLoop.h>
+#include <muduo/base/Logging.h>
+#include <coroutine>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+/*
+业务处理函数使用的C++20协程
+Task: 立即开始执行、执行完自动销毁的协程类型, 调用者不等待它的结果
+BlockingCall: 可co_await的阻塞调用, 把MySQL、Redis这样的阻塞操作交给业务线程执行,
+执行完后通过EventLoop::runInLoop回到连接所在的IO线程恢复协程
+ParallelCall: 可co_await的一组互不依赖的阻塞调用, 第一个在用户自己的业务线程中执行, 其余的交给扇出线程池同时执行,
+全部完成后恢复协程
+协程挂起期间不占用IO线程, 但MySQL、Redis客户端是阻塞的, 每个进行中的阻塞调用仍然占用一个业务线程:
+协程只是把阻塞从IO线程转移到业务线程, 并不是非阻塞IO, 同时进行的数据库操作数受业务线程数限制
+
+注意: 协程的参数必须按值传递, 第一次挂起之后调用者的引用参数就已经失效了
+*/
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() { return Task(); }
+        suspend_never initial_suspend() noexcept { return {}; }
+        suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+
+        // 业务异常只记录日志, 不影响IO线程
+        void unhandled_exception()
+        {
+            try
+            {
+                rethrow_exception(current_exception());
+            }
+            catch (const exception &e)
+            {
+                LOG_ERROR << "unhandled exception in coroutine: " << e.what();
+            }
+            catch (...)
+            {
+                LOG_ERROR << "unhandled exception in coroutine";
+            }
+        }
+    };
+};
+
+// 在业务线程中执行阻塞调用func, 完成后在loop中恢复协程, co_await的结果是func的返回值
+template <typename Func>
+class BlockingCall
+{
+public:
+    using Result = invoke_result_t<Func>;
+
+    BlockingCall(WorkerPool &pool, size_t key, EventLoop *loop, Func func)
+        : _pool(pool), _key(key), _loop(loop), _func(std::move(func))
+    {
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    // 返回false表示不挂起, 直接继续执行协程
+    bool await_suspend(coroutine_handle<> handle)
+    {
+        if (_pool.size() == 0) // 没有业务线程, 直接在当前的IO线程中执行
+        {
+            call();
+            return false;
+        }
+
+        _pool.submit(_key, [this, handle]()
+        {
+            call();
+            _loop->runInLoop([handle]() { handle.resume(); });
+        });
+        return true;
+    }
+
+    Result await_resume()
+    {
+        if (_error) // 阻塞调用抛出的异常在协程中重新抛出
+        {
+            rethrow_exception(_error);
+        }
+        if constexpr (!is_void_v<Result>)
+        {
+            return std::move(*_result);
+        }
+    }
+
+private:
+    void call()
+    {
+        try
+        {
+            if constexpr (is_void_v<Result>)
+            {
+                _func();
+            }
+            else
+            {
+                _result.emplace(_func());
+            }
+        }
+        catch (...)
+        {
+            _error = current_exception();
+        }
+    }
+
+    WorkerPool &_pool;
+    size_t _key;
+    EventLoop *_loop;
+    Func _func;
+    conditional_t<is_void_v<Result>, monostate, optional<Result>> _result;
+    exception_ptr _error;
+};
+
+// 把一组互不依赖的阻塞调用同时执行, 全部完成后在loop中恢复协程
+// co_await的结果是各调用返回值组成的tuple, 总耗时接近其中最慢的一个, 而不是所有调用耗时之和
+// 第一个调用在pool中key对应的业务线程中执行, 与该用户的其它任务保持顺序;
+// 其余调用交给fanout线程池, 与任何用户的任务之间都没有顺序保证, 不能访问按用户串行的状态(会话、在线状态、离线消息),
+// 也不会占用其他用户的业务线程、打乱其他用户的任务顺序
+template <typename... Funcs>
+class ParallelCall
+{
+public:
+    using Result = tuple<invoke_result_t<Funcs>...>;
+
+    ParallelCall(WorkerPool &pool, WorkerPool &fanout, size_t key, EventLoop *loop, Funcs... funcs)
+        : _pool(pool), _fanout(fanout), _key(key), _loop(loop), _funcs(std::move(funcs)...)
+    {
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    // 返回false表示不挂起, 直接继续执行协程
+    bool await_suspend(coroutine_handle<> handle)
+    {
+        if (_pool.size() == 0) // 没有业务线程, 依次在当前的IO线程中执行
+        {
+            callAll(index_sequence_for<Funcs...>{});
+            return false;
+        }
+
+        submitAll(handle, index_sequence_for<Funcs...>{});
+        return true;
+    }
+
+    Result await_resume()
+    {
+        for (exception_ptr &error : _errors) // 任意一个调用抛出的异常在协程中重新抛出
+        {
+            if (error)
+            {
+                rethrow_exception(error);
+            }
+        }
+        return takeResults(index_sequence_for<Funcs...>{});
+    }
+
+private:
+    template <size_t I>
+    void call()
+    {
+        try
+        {
+            get<I>(_results).emplace(get<I>(_funcs)());
+        }
+        catch (...)
+        {
+            _errors[I] = current_exception(); // 每个调用只写自己的位置, 不需要加锁
+        }
+    }
+
+    template <size_t... Is>
+    void callAll(index_sequence<Is...>)
+    {
+        (call<Is>(), ...);
+    }
+
+    template <size_t... Is>
+    void submitAll(coroutine_handle<> handle, index_sequence<Is...>)
+    {
+        ((Is == 0 ? _pool : _fanout).submit(_key + Is, [this, handle]()
+        {
+            call<Is>();
+            if (_pending.fetch_sub(1) == 1) // 最后一个完成的调用负责恢复协程
+            {
+                _loop->runInLoop([handle]() { handle.resume(); });
+            }
+        }), ...);
+    }
+
+    template <size_t... Is>
+    Result takeResults(index_sequence<Is...>)
+    {
+        return Result(std::move(*get<Is>(_results))...);
+    }
+
+    WorkerPool &_pool;
+    WorkerPool &_fanout;
+    size_t _key;
+    EventLoop *_loop;
+    tuple<Funcs...> _funcs;
+    tuple<optional<invoke_result_t<Funcs>>...> _results;
+    array<exception_ptr, sizeof...(Funcs)> _errors;
+    atomic<size_t> _pending{sizeof...(Funcs)};
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include "db.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+using namespace std;
+
+/*
+一个MySQL服务器的连接池, 主库和每个从库各有一个, 由DbRouter创建和选择
+原来每次数据库操作都要新建一个MySQL连接(TCP握手 + 认证), 一次登录要建立约6个连接
+连接池预先建立minSize个连接, 不够用时按需新建, 最多maxSize个; 连接都在使用中时取连接的线程等待, 超过等待时间返回nullptr
+空闲超过idleSeconds秒的连接由后台线程关闭, 直到只剩minSize个
+空闲过一段时间的连接在取出前先mysql_ping检查, 出现客户端错误(连接断开)的连接归还时直接关闭
+*/
+class ConnectionPool
+{
+public:
+    explicit ConnectionPool(const DbEndpoint &endpoint) : _endpoint(endpoint) {}
+
+    ConnectionPool(const ConnectionPool &) = delete;
+    ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+    // 建立minSize个连接并启动空闲连接回收线程, 在使用连接池之前调用一次
+    void init(size_t minSize, size_t maxSize, int idleSeconds, int waitTimeoutMs);
+
+    // 可在任意线程调用: 取出一个可用的连接, shared_ptr析构时自动归还给连接池
+    // 等待超时或无法建立新连接时返回nullptr
+    shared_ptr<MySQL> getConnection();
+
+    ~ConnectionPool();
+
+    // 连接池对应的数据库服务器
+    const DbEndpoint &endpoint() const { return _endpoint; }
+
+private:
+    // 新建一个连接, 失败时返回nullptr
+    MySQL *createConnection();
+
+    // 归还连接
+    void release(MySQL *conn);
+
+    // 关闭一个连接, 调用时不持有锁
+    void closeConnection(MySQL *conn);
+
+    // 后台线程: 周期性地关闭空闲太久的连接
+    void scanIdleConnections();
+
+    DbEndpoint _endpoint;
+
+    mutex _mutex;
+    condition_variable _cond;     // 有连接被归还或连接总数减少时通知等待的线程
+    deque<MySQL *> _idle;         // 空闲连接, 从尾部取出和归还, 头部是空闲最久的连接
+    size_t _total = 0;            // 已建立的连接数(空闲 + 使用中 + 正在建立)
+    size_t _minSize = 0;
+    size_t _maxSize = 32;
+    int _idleSeconds = 60;        // 0表示不回收空闲连接
+    int _waitTimeoutMs = 3000;
+
+    bool _stopping = false;
+    condition_variable _scanCond; // 用于唤醒回收线程退出
+    thread _scanner;
+};
+
+#endif
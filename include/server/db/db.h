@@ -2,17 +2,33 @@
 #define DB_H
 
 #include <string>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
 #include <mysql/mysql.h>
+#include "resultset.hpp"
 using namespace std;
 
+struct PreparedStatement;
+
+// 数据库服务器的地址和账号, 默认值是原来写在db.cpp中的配置
+struct DbEndpoint
+{
+    string host = "127.0.0.1";
+    unsigned int port = 3306;
+    string user = "root";
+    string password = "123456";
+    string dbname = "chat";
+};
+
 // 数据库操作类
 class MySQL
 {
 public:
-    // 初始化数据库连接
-    MySQL();
+    // 初始化数据库连接, connect时连接endpoint指定的服务器
+    explicit MySQL(const DbEndpoint &endpoint = DbEndpoint());
 
-    // 释放数据库连接资源
+    // 释放数据库连接资源, 同时关闭该连接上缓存的预处理语句
     ~MySQL();
 
     // 连接数据库
@@ -24,10 +40,40 @@ public:
     // 查询操作
     MYSQL_RES *query(string sql);
 
+    // 查询操作, 返回逐行读取的结果集, 析构时自动释放; 查询失败时结果集为空
+    ResultSet cursor(const string &sql);
+
     // 获取连接  用于在usermodel.cpp的insert函数里获取插入成功的用户数据生成的主键id
     MYSQL* getConnection();
+
+    // 转义字符串中的特殊字符, 结果可以放在SQL语句的单引号中, 用于无法使用预处理语句的动态SQL
+    string escape(const string &value);
+
+    // 检查连接是否仍然可用, 断开时返回false
+    bool ping();
+
+    // 上一次操作是否出现了客户端错误(如与服务器的连接已断开), 连接池不再复用这样的连接
+    bool broken() const { return _broken; }
+
+    // 刷新连接进入空闲状态的时间点, 连接归还给连接池时调用
+    void refreshAliveTime() { _aliveTime = chrono::steady_clock::now(); }
+
+    // 连接已经空闲的秒数
+    double idleSeconds() const
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - _aliveTime).count();
+    }
 private:
+    // 记录失败的原因, 客户端错误码(2000~2999)表示连接本身出了问题
+    void checkError();
+
+    friend class Statement;
+
     MYSQL *_conn;
+    DbEndpoint _endpoint;
+    unordered_map<const char *, unique_ptr<PreparedStatement>> _stmts; // 该连接上已经准备好的预处理语句, key是SQL字符串常量的地址
+    bool _broken = false;
+    chrono::steady_clock::time_point _aliveTime = chrono::steady_clock::now();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef DBROUTER_H
+#define DBROUTER_H
+
+#include "connectionpool.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/*
+数据库读写分离, 所有的Model通过它取连接
+写操作和要求读到最新数据的读操作使用主库(primary), 只读且允许稍有延迟的读操作使用从库(replica)
+后台线程每秒检查每个从库的复制延迟(Seconds_Behind_Source), 延迟超过maxLagSeconds、复制已停止或连接不上的从库不再分配读请求,
+恢复后重新分配; 没有可用的从库时读操作回退到主库
+*/
+class DbRouter
+{
+public:
+    // 获取单例对象的接口函数
+    static DbRouter *instance();
+
+    // 为主库和每个从库创建连接池并启动复制延迟检测线程, 在使用数据库之前调用一次
+    // 各连接池的参数相同, 见ConnectionPool::init
+    void init(const DbEndpoint &primary, const vector<DbEndpoint> &replicas,
+              size_t poolMin, size_t poolMax, int idleSeconds, int waitTimeoutMs, int maxLagSeconds);
+
+    // 可在任意线程调用: 取出一个主库连接, 失败时返回nullptr
+    shared_ptr<MySQL> primary();
+
+    // 可在任意线程调用: 轮流从健康的从库取出一个连接, 没有可用的从库时返回主库连接
+    shared_ptr<MySQL> replica();
+
+    ~DbRouter();
+
+private:
+    DbRouter() = default;
+
+    struct Replica
+    {
+        unique_ptr<ConnectionPool> pool;
+        unique_ptr<MySQL> monitor;     // 检测复制延迟专用的连接, 不占用连接池
+        atomic<bool> healthy{false};
+    };
+
+    // 检测一个从库的复制延迟, 返回该从库是否可以分配读请求
+    bool checkReplica(Replica &replica);
+
+    // 后台线程: 每秒检测一次所有从库
+    void monitorReplicas();
+
+    unique_ptr<ConnectionPool> _primary;
+    vector<unique_ptr<Replica>> _replicas;
+    atomic<size_t> _next{0};           // 轮询从库的位置
+    int _maxLagSeconds = 2;
+
+    mutex _mutex;
+    condition_variable _cond;          // 用于唤醒检测线程退出
+    bool _stopping = false;
+    thread _monitor;
+};
+
+#endif
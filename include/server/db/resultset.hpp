@@ -0,0 +1,117 @@
+#ifndef RESULTSET_H
+#define RESULTSET_H
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <mysql/mysql.h>
+using namespace std;
+
+// 结果集中的一行, 列数据指向MySQL C API内部的缓冲区, 只在读取下一行之前有效
+class Row
+{
+public:
+    Row(MYSQL_ROW row, unsigned long *lengths) : _row(row), _lengths(lengths) {}
+
+    // 第col列是否为NULL
+    bool isNull(int col) const { return _row[col] == nullptr; }
+
+    // 第col列的字符串值, 不复制数据, NULL返回空串
+    string_view getStringView(int col) const
+    {
+        return _row[col] != nullptr ? string_view(_row[col], _lengths[col]) : string_view();
+    }
+
+    // 第col列的字符串值, 复制一份
+    string getString(int col) const { return string(getStringView(col)); }
+
+    // 第col列的整数值, 直接解析缓冲区中的数字, NULL或非数字返回0
+    int64_t getInt(int col) const
+    {
+        string_view s = getStringView(col);
+        int64_t value = 0;
+        from_chars(s.data(), s.data() + s.size(), value);
+        return value;
+    }
+
+private:
+    MYSQL_ROW _row;
+    unsigned long *_lengths;
+};
+
+/*
+逐行读取的结果集(mysql_use_result), 行数据不在客户端缓存, 析构时释放
+用法:
+    ResultSet rows = mysql->cursor(sql);
+    for (const Row &row : rows) { int id = row.getInt(0); string_view name = row.getStringView(1); ... }
+每次只有一行数据在内存中, 调用者边读边处理, 不需要先把所有行复制到vector中
+读取期间该连接不能执行其它语句, 没有读完的行在析构时丢弃
+*/
+class ResultSet
+{
+public:
+    // 行迭代器, 只能向前遍历一次
+    class iterator
+    {
+    public:
+        iterator(ResultSet *rs) : _rs(rs) {}
+
+        Row operator*() const { return Row(_rs->_row, _rs->_lengths); }
+        iterator &operator++()
+        {
+            _rs->next();
+            return *this;
+        }
+        // 与end()比较: 没有更多的行时相等
+        bool operator!=(const iterator &) const { return _rs != nullptr && _rs->_row != nullptr; }
+
+    private:
+        ResultSet *_rs;
+    };
+
+    explicit ResultSet(MYSQL_RES *res = nullptr) : _res(res) {}
+    ~ResultSet()
+    {
+        if (_res != nullptr)
+        {
+            mysql_free_result(_res);
+        }
+    }
+
+    ResultSet(ResultSet &&other) noexcept : _res(other._res), _row(other._row), _lengths(other._lengths)
+    {
+        other._res = nullptr;
+    }
+    ResultSet(const ResultSet &) = delete;
+    ResultSet &operator=(const ResultSet &) = delete;
+
+    // 查询是否成功
+    explicit operator bool() const { return _res != nullptr; }
+
+    // 读取第一行, 查询失败时begin() == end()
+    iterator begin()
+    {
+        if (_res == nullptr)
+        {
+            return iterator(nullptr);
+        }
+        next();
+        return iterator(this);
+    }
+    iterator end() { return iterator(nullptr); }
+
+private:
+    // 读取下一行
+    void next()
+    {
+        _row = mysql_fetch_row(_res);
+        _lengths = _row != nullptr ? mysql_fetch_lengths(_res) : nullptr;
+    }
+
+    MYSQL_RES *_res;
+    MYSQL_ROW _row = nullptr;
+    unsigned long *_lengths = nullptr;
+};
+
+#endif
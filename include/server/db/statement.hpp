@@ -0,0 +1,91 @@
+#ifndef STATEMENT_H
+#define STATEMENT_H
+
+#include "db.h"
+#include <string>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+// MYSQL_BIND中is_null、error字段指向的类型, MySQL 8.0中是bool, 之前的版本是my_bool
+using BindFlag = remove_pointer<decltype(MYSQL_BIND::is_null)>::type;
+
+// 缓存在连接上的一条预处理语句, 以及参数和结果列的绑定缓冲区, 多次执行之间复用
+struct PreparedStatement
+{
+    // 结果列的缓冲区, 整数列按64位整数绑定, 其余的列按字符串绑定
+    struct Column
+    {
+        bool isInt = false;
+        int64_t intValue = 0;
+        vector<char> buffer;
+        unsigned long length = 0;
+        BindFlag isNull = 0;
+        BindFlag error = 0;
+    };
+
+    MYSQL_STMT *stmt = nullptr;
+    vector<MYSQL_BIND> params;
+    vector<int64_t> intParams;
+    vector<string> strParams;
+    vector<unsigned long> paramLengths;
+    vector<MYSQL_BIND> results;
+    vector<Column> columns;
+
+    ~PreparedStatement()
+    {
+        if (stmt != nullptr)
+        {
+            mysql_stmt_close(stmt);
+        }
+    }
+};
+
+/*
+预处理语句的一次执行, 用法:
+    Statement stmt(*mysql, "select name, state from user where id = ?");
+    stmt.bind(id);
+    if (stmt.execute() && stmt.fetch()) { string name = stmt.getString(0); ... }
+语句在每个连接上只准备一次, 之后按SQL字符串常量的地址从连接的缓存中取出, 服务器不再重复解析SQL
+参数和结果都以二进制协议传输, 参数不需要拼接和转义, 整数列不需要atoi
+结果集不在客户端缓存, fetch逐行读取, 析构时释放没有读完的结果
+*/
+class Statement
+{
+public:
+    // sql必须是字符串常量, 缓存以其地址为key
+    Statement(MySQL &mysql, const char *sql);
+    ~Statement();
+
+    Statement(const Statement &) = delete;
+    Statement &operator=(const Statement &) = delete;
+
+    // 按顺序绑定下一个参数
+    Statement &bind(int64_t value);
+    Statement &bind(const string &value);
+
+    // 执行语句, 参数个数不对或执行失败时返回false
+    bool execute();
+
+    // 读取结果集的下一行, 没有更多行或出错时返回false
+    bool fetch();
+
+    // 当前行第col列的值, NULL返回0或空字符串
+    int64_t getInt(int col) const;
+    string getString(int col) const;
+
+    // insert语句生成的自增id
+    uint64_t insertId() const;
+
+private:
+    // 检查语句的错误, 客户端错误表示连接已经不可用
+    void checkError();
+
+    MySQL &_mysql;
+    const char *_sql;
+    PreparedStatement *_prepared = nullptr; // 准备失败时为nullptr
+    size_t _nextParam = 0;
+    bool _executed = false;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef DELIVERYQUEUE_H
+#define DELIVERYQUEUE_H
+
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+#include <atomic>
+#include <vector>
+#include "chatcodec.hpp"
+#include "mpscqueue.hpp"
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+/*
+每个IO线程(EventLoop)一个的消息投递聚合器
+群聊扇出时同一个接收方在一轮事件循环内可能收到几十条消息, 逐条调用TcpConnection::send
+会产生大量小的write系统调用, 跨线程时还要为每条消息排队一个任务
+聚合器把发往本EventLoop上连接的消息帧先收集起来, 在本轮事件循环处理完IO事件后(queueInLoop的任务)
+统一flush: 每个连接的所有消息帧拼接到一个缓冲区中, 只调用一次send
+待发送的消息帧放在无锁的MPSC队列中, 入队本身不加锁; 每批消息提交一次flush任务,
+queueInLoop会短暂持有muduo的pendingFunctors互斥锁, 所以是每批一次加锁, 而不是每条消息一次
+*/
+class DeliveryQueue
+{
+public:
+    explicit DeliveryQueue(EventLoop *loop);
+
+    DeliveryQueue(const DeliveryQueue &) = delete;
+    DeliveryQueue &operator=(const DeliveryQueue &) = delete;
+
+    // 可在任意线程调用: 把发往con的消息帧放入待发送队列, 本轮事件循环结束时统一发送
+    void enqueue(const TcpConnectionPtr &con, const FramePtr &frame);
+
+    // 在loop线程中调用: 先取出队列中已有的消息帧, 再接上frames, 一起按连接合并后立即发送,
+    // frames排在此前入队的消息之后, 与经enqueue发送的消息保持先后顺序
+    void sendInLoop(const vector<pair<TcpConnectionPtr, FramePtr>> &frames);
+
+private:
+    // 在loop线程中执行, 发送所有待发送的消息帧
+    void flush();
+
+    // 取出队列中所有待发送的消息帧, 追加到pending末尾
+    void takePending(vector<pair<TcpConnectionPtr, FramePtr>> &pending);
+
+    // 按连接合并pending中的消息帧并发送, 同一个连接的消息保持原有顺序
+    static void sendFrames(const vector<pair<TcpConnectionPtr, FramePtr>> &pending);
+
+    EventLoop *_loop;
+
+    // 待发送的消息帧, 保持入队顺序, enqueue可能来自其它IO线程、业务线程
+    MpscQueue<pair<TcpConnectionPtr, FramePtr>> _pending;
+    atomic<bool> _flushQueued;       // 是否已经向loop提交了flush任务
+    atomic<int64_t> _batchStartMicros; // 本批消息第一次入队的时间, 用于统计flush延迟
+};
+
+#endif
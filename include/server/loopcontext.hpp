@@ -0,0 +1,39 @@
+#ifndef LOOPCONTEXT_H
+#define LOOPCONTEXT_H
+
+#include <muduo/net/EventLoop.h>
+#include <boost/any.hpp>
+#include <memory>
+#include "deliveryqueue.hpp"
+#include "timingwheel.hpp"
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 每个IO线程(EventLoop)的私有状态, 在IO线程启动时创建, 通过EventLoop::setContext挂到EventLoop上
+// 创建之后挂载关系不再改变, 其它线程可以安全地读取
+struct LoopContext
+{
+    LoopContext(EventLoop *loop, int idleSeconds)
+        : deliveryQueue(loop), timingWheel(loop, idleSeconds)
+    {
+    }
+
+    DeliveryQueue deliveryQueue; // 本EventLoop上连接的消息投递聚合器
+    TimingWheel timingWheel;     // 本EventLoop上连接的空闲检测时间轮, 只在本IO线程中访问
+};
+
+using LoopContextPtr = shared_ptr<LoopContext>;
+
+// 获取EventLoop上挂的私有状态, 未初始化的EventLoop返回空指针
+inline LoopContext *getLoopContext(EventLoop *loop)
+{
+    const boost::any &context = loop->getContext();
+    if (context.empty())
+    {
+        return nullptr;
+    }
+    return boost::any_cast<LoopContextPtr>(&context)->get();
+}
+
+#endif
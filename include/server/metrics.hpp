@@ -0,0 +1,77 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+using namespace std;
+
+// 服务器运行指标, 各模块在各自的线程中用原子变量累加, 由主线程的定时任务周期性输出到日志
+class Metrics
+{
+public:
+    // 获取单例对象的接口函数
+    static Metrics *instance();
+
+    // 将当前所有指标格式化成一行文本
+    string report() const;
+
+    // 原子地更新最大值
+    static void updateMax(atomic<int64_t> &target, int64_t value);
+
+    // 连接相关指标
+    atomic<int64_t> acceptedConnections{0}; // 所有acceptor累计接受的连接数
+    atomic<int64_t> idleEvictions{0};       // 因空闲超时被关闭的连接数
+
+    // 准入控制相关指标
+    atomic<int64_t> rejectedConnections{0}; // 超出准入预算被拒绝的新连接数
+    atomic<int64_t> rejectedLogins{0};      // 超出准入预算被拒绝的登录请求数
+
+    // 业务线程池相关指标
+    atomic<int64_t> workerTasks{0};         // 业务线程执行的任务数
+    atomic<int64_t> workerWaitMicros{0};    // 任务在业务线程队列中的累计等待时间(微秒)
+    atomic<int64_t> workerMaxWaitMicros{0}; // 任务在业务线程队列中的最大等待时间(微秒)
+
+    // MySQL连接池相关指标
+    atomic<int64_t> dbAcquires{0};           // 从连接池取出连接的次数
+    atomic<int64_t> dbWaitMicros{0};         // 取连接的累计耗时(微秒), 包括等待和新建连接
+    atomic<int64_t> dbMaxWaitMicros{0};      // 取连接的最大耗时(微秒)
+    atomic<int64_t> dbWaitTimeouts{0};       // 等待空闲连接超时的次数
+    atomic<int64_t> dbCreatedConnections{0}; // 累计建立的连接数
+    atomic<int64_t> dbClosedConnections{0};  // 累计关闭的连接数(空闲回收和连接断开)
+    atomic<int64_t> dbReplicaReads{0};       // 分配到从库的读操作数
+    atomic<int64_t> dbReplicaFallbacks{0};   // 没有可用的从库而回退到主库的读操作数
+
+    // 离线消息批量写入(OfflineMsgWriter)相关指标
+    atomic<int64_t> offlineFlushes{0};        // 写入线程取出队列写入数据库的次数
+    atomic<int64_t> offlineBatches{0};        // 执行成功的多行INSERT语句数
+    atomic<int64_t> offlineRows{0};           // 写入成功的离线消息数
+    atomic<int64_t> offlineMaxBatch{0};       // 单条INSERT语句写入的最大行数
+    atomic<int64_t> offlineFailedRows{0};     // 重试后仍写入失败的离线消息数
+    atomic<int64_t> offlineFlushMicros{0};    // 写入数据库的累计耗时(微秒)
+    atomic<int64_t> offlineMaxFlushMicros{0}; // 单次写入的最大耗时(微秒)
+    atomic<int64_t> offlineQueueFull{0};      // 队列已满导致追加消息的线程等待(或改为直接写入)的次数
+
+    // 会话路由(SessionRouter)相关指标
+    atomic<int64_t> routerCommands{0};      // 放入各IO线程会话表队列的命令数
+    atomic<int64_t> routerDirectFrames{0};  // 归属线程就是连接所在线程, 直接发送的消息帧数
+
+    // 投递聚合器(DeliveryQueue)相关指标
+    atomic<int64_t> deliveryFlushes{0};     // flush次数(每次flush一个EventLoop上所有待发送的消息)
+    atomic<int64_t> deliveryWrites{0};      // flush时对连接发起的写操作次数, 每个连接每次flush只写一次
+    atomic<int64_t> deliveryFrames{0};      // flush发送出去的消息帧总数
+    atomic<int64_t> deliveryBytes{0};       // flush发送出去的字节总数(含长度头)
+    atomic<int64_t> deliveryMaxBatch{0};    // 单个连接一次写入合并的最大消息帧数
+    atomic<int64_t> deliveryFlushMicros{0}; // 从一批消息第一次入队到flush完成的累计耗时(微秒)
+    atomic<int64_t> deliveryMaxFlushMicros{0}; // 单次flush的最大耗时(微秒)
+
+    // 慢消费者背压相关指标
+    atomic<int64_t> throttledConnections{0}; // 当前处于限流状态的连接数
+    atomic<int64_t> throttleEvents{0};       // 连接进入限流状态的累计次数
+    atomic<int64_t> spilledMessages{0};      // 因接收方限流而转存为离线消息的消息数
+
+private:
+    Metrics() = default;
+};
+
+#endif
@@ -1,22 +1,42 @@
 #ifndef OFFLINEMESSAGEMODEL_H
 #define OFFLINEMESSAGEMODEL_H
 
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 using namespace std;
 
-// offlinemessage表的数据操作类,提供离线消息表的操作接口方法
+/*
+offlinemessage表的数据操作类,提供离线消息表的操作接口方法
+表结构:
+    CREATE TABLE offlinemessage(
+        id BIGINT NOT NULL AUTO_INCREMENT PRIMARY KEY, -- 单调递增的消息id, 同一个用户的消息按id有序
+        userid INT NOT NULL,
+        message TEXT NOT NULL,
+        KEY idx_userid_id (userid, id)
+    );
+离线消息按id分批下发, 客户端确认收到某个id之前的消息后再按范围删除
+*/
 class offlineMsgModel
 {
 public:
     // 存储用户的离线消息
-    void insert(int userid, string msg);
+    void insert(int userid, const string &msg);
 
-    // 删除用户的离线消息
-    void remove(int userid);
+    // 用一条多行INSERT存储count条离线消息(用户id, 消息), 成功返回true
+    // 失败时retryable表示这批消息一定没有写入, 可以安全地重试: 没有取到连接、连接在发送语句前已经断开,
+    // 或者服务器因死锁、锁等待超时回滚了这条语句; 执行中途连接断开时无法确定是否已经提交, 重试可能重复写入
+    bool insertBatch(const pair<int, string> *msgs, size_t count, bool &retryable);
 
-    // 查询用户的离线消息,可能有多条,查到的消息用vector容器存储
-    vector<string> query(int userid);
+    // 删除用户id不超过maxId的离线消息
+    void removeUpTo(int userid, int64_t maxId);
+
+    // 按id顺序逐条读取用户id大于afterId的离线消息, 最多limit条, 每读到一条就交给func(消息id, 消息)处理
+    // func的消息参数指向数据库结果集的缓冲区, 只在本次调用期间有效; 返回之后是否还有更多的离线消息
+    bool fetch(int userid, int64_t afterId, size_t limit, const function<void(int64_t, string_view)> &func);
 };
 
 #endif
\ No newline at end of file
@@ -10,9 +10,15 @@ public:
     // User表添加新用户的方法 参数为User对象的引用 
     bool insert(User &user);
 
-    // 根据用户id查询用户信息
+    // 根据用户id查询用户信息, 读从库, 结果可能稍有延迟, 只用于展示
     User query(int id);
 
+    // 根据用户id查询用户信息, 读主库, 用于登录时校验密码和在线状态
+    User queryPrimary(int id);
+
+    // 查询用户的在线状态, 读主库, 用于决定消息走redis转发还是存为离线消息, 用户不存在时返回空串
+    string queryState(int id);
+
     // 更新用户的状态信息
     bool updateState(User user);
 
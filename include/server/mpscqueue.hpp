@@ -0,0 +1,71 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+using namespace std;
+
+/*
+无锁的多生产者单消费者队列(基于链表, Dmitry Vyukov的算法)
+push可以在任意线程中调用, 只需要一次原子交换; pop只能在唯一的消费者线程(IO线程)中调用
+生产者和消费者之间没有锁, 生产者之间也不会互相阻塞
+*/
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue()
+        : _tail(new Node) // 初始时队列中只有一个哨兵节点
+    {
+        _head.store(_tail);
+    }
+
+    ~MpscQueue()
+    {
+        T value;
+        while (pop(value))
+        {
+        }
+        delete _tail;
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    // 可在任意线程调用
+    void push(T value)
+    {
+        Node *node = new Node;
+        node->value = std::move(value);
+        Node *prev = _head.exchange(node); // 把新节点挂为新的队头
+        prev->next.store(node);            // 再把它链接到前一个节点之后, 此前消费者看不到它
+    }
+
+    // 只能在消费者线程中调用, 队列为空(或新节点还没有链接上)时返回false
+    bool pop(T &value)
+    {
+        Node *tail = _tail;
+        Node *next = tail->next.load();
+        if (next == nullptr)
+        {
+            return false;
+        }
+        value = std::move(next->value);
+        next->value = T(); // next成为新的哨兵节点, 释放它持有的资源
+        _tail = next;
+        delete tail;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        atomic<Node *> next{nullptr};
+        T value;
+    };
+
+    atomic<Node *> _head; // 生产者一侧, 最新入队的节点
+    Node *_tail;          // 消费者一侧, 哨兵节点, 它的next是下一个要出队的节点
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef MSGREQUEST_H
+#define MSGREQUEST_H
+
+#include "chatcodec.hpp"
+#include "json.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+using namespace std;
+using json = nlohmann::json;
+
+/*
+各业务请求的类型化表示, 分发时从json中解码一次, 业务处理函数不再直接访问json
+decode在字段缺失或类型不对时返回false, 该消息被丢弃, 不会因为json取值抛出异常
+*/
+
+// 所有请求的公共字段
+struct RequestBase
+{
+    // 客户端可选携带的请求id, 服务器原样回填到对应的_ACK中,
+    // 客户端可以在一个连接上同时发出多个请求, 按reqId匹配先后完成的响应
+    optional<int64_t> reqId;
+
+    // 解码公共字段, reqId存在但不是整数时返回false
+    bool decodeBase(const json &js);
+
+    // 把reqId回填到响应中, 请求没有携带reqId时不回填
+    void echoReqId(json &response) const;
+};
+
+// 登录请求 id password [binary]
+struct LoginRequest : RequestBase
+{
+    int id = -1;
+    string password;
+    bool binary = false; // 客户端是否支持二进制格式的聊天消息
+
+    bool decode(const json &js, const FramePtr &frame);
+};
+
+// 注册请求 name password
+struct RegRequest : RequestBase
+{
+    string name;
+    string password;
+
+    bool decode(const json &js, const FramePtr &frame);
+};
+
+// 注销请求 id
+struct LoginoutRequest : RequestBase
+{
+    int id = -1;
+
+    bool decode(const json &js, const FramePtr &frame);
+};
+
+// 一对一聊天请求 id toid msg [name time], 消息内容原样转发
+struct OneChatRequest : RequestBase
+{
+    int id = -1;
+    int toid = -1;
+    FramePtr frame; // 转发给接收方的消息帧, 通常就是客户端发来的原始帧, 见chatRelayFrame
+
+    bool decode(const json &js, const FramePtr &frame);
+};
+
+// 添加好友请求 id friendid
+struct AddFriendRequest : RequestBase
+{
+    int id = -1;
+    int friendid = -1;
+
+    bool decode(const json &js, const FramePtr &frame);
+};
+
+// 创建群组请求 id groupname groupdesc
+struct CreateGroupRequest : RequestBase
+{
+    int id = -1;
+    string groupname;
+    string groupdesc;
+
+    bool decode(const json &js, const FramePtr &frame);
+};
+
+// 加入群组请求 id groupid
+struct AddGroupRequest : RequestBase
+{
+    int id = -1;
+    int groupid = -1;
+
+    bool decode(const json &js, const FramePtr &frame);
+};
+
+// 群组聊天请求 id groupid msg [name time], 消息内容原样转发
+struct GroupChatRequest : RequestBase
+{
+    int id = -1;
+    int groupid = -1;
+    FramePtr frame; // 转发给接收方的消息帧, 通常就是客户端发来的原始帧, 见chatRelayFrame
+
+    bool decode(const json &js, const FramePtr &frame);
+};
+
+// 离线消息确认 lastId
+struct OfflineAckRequest : RequestBase
+{
+    int64_t lastId = 0;
+
+    bool decode(const json &js, const FramePtr &frame);
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef OFFLINEMSGWRITER_H
+#define OFFLINEMSGWRITER_H
+
+#include "offlinemessagemodel.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+using namespace std;
+
+/*
+离线消息的批量写入器(group commit)
+群聊消息的接收者大多不在线时, 原来每个接收者都要单独执行一次单行INSERT
+现在各业务线程只把离线消息放入队列, 由写入线程合并成多行INSERT写入数据库:
+第一条消息入队flushMs毫秒后, 或者队列中累计了batchRows条消息时写入一批
+队列最多maxQueued条消息, 队列满时append阻塞调用者, 因此不能在IO线程中调用append, IO线程中可能执行的调用者用tryAppend
+写入失败时只在确定没有写入的情况下重试一次(见offlineMsgModel::insertBatch), 不会重复写入同一批消息
+*/
+class OfflineMsgWriter
+{
+public:
+    OfflineMsgWriter() = default;
+    ~OfflineMsgWriter();
+
+    OfflineMsgWriter(const OfflineMsgWriter &) = delete;
+    OfflineMsgWriter &operator=(const OfflineMsgWriter &) = delete;
+
+    // 启动写入线程, 不调用时append直接在调用者的线程中写入数据库
+    void start(int flushMs, size_t batchRows, size_t maxQueued);
+
+    // 停止写入线程, 队列中剩余的消息会先写入数据库
+    void stop();
+
+    // 可在任意业务线程调用: 追加一条用户userid的离线消息
+    void append(int userid, const string &msg);
+
+    // 可在任意线程调用: 不等待的追加, 队列已满或写入线程没有运行时返回false, 由调用者自己写入数据库
+    bool tryAppend(int userid, const string &msg);
+
+    // 等待在此之前追加的所有离线消息都已写入数据库, 读取离线消息之前调用, 避免漏掉还在队列中的消息
+    void sync();
+
+private:
+    // 把消息放入队列并在需要时通知写入线程, 调用时持有_mutex
+    void push(int userid, const string &msg);
+
+    // 写入线程的主循环
+    void run();
+
+    // 把一批消息写入数据库, 调用时不持有锁
+    void write(vector<pair<int, string>> &batch);
+
+    offlineMsgModel _model;
+
+    mutex _mutex;
+    condition_variable _notEmpty;    // 队列中有消息、需要立即写入或需要退出时通知写入线程
+    condition_variable _notFull;     // 队列有空位时通知等待的append
+    condition_variable _written;     // 一批消息写完时通知等待的sync
+    vector<pair<int, string>> _queue;
+    chrono::steady_clock::time_point _firstQueued; // 队列中第一条消息的入队时间
+    uint64_t _appendedCount = 0;     // 累计入队的消息数
+    uint64_t _writtenCount = 0;      // 累计处理完(写入或失败)的消息数
+    int _syncWaiters = 0;            // 正在sync的线程数, 大于0时写入线程不再等待凑批
+
+    chrono::milliseconds _flushInterval{10};
+    size_t _batchRows = 500;
+    size_t _maxQueued = 100000;
+    bool _running = false;
+    bool _stopping = false;
+    thread _thread;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <hiredis/hiredis.h>
 #include <thread>
 #include <functional>
+#include <mutex>
 using namespace std;
 
 /*
@@ -20,7 +21,7 @@ public:
     bool connect();
 
     // 向redis指定的通道channel发布消息
-    bool publish(int channel, string message);
+    bool publish(int channel, const string &message);
 
     // 向redis指定的通道subscribe订阅消息
     bool subscribe(int channel);
@@ -41,6 +42,10 @@ private:
     // hiredis同步上下文对象, 负责subscribe消息
     redisContext *_subcribe_context;
 
+    // hiredis上下文不是线程安全的, 多个业务线程同时publish/subscribe时需要互斥
+    mutex _publishMutex;
+    mutex _subscribeMutex; // 只保护订阅命令的发送, 订阅消息的接收只在observer_channel_message的线程中进行
+
     // 回调操作, 收到订阅的消息, 给service层上报  int型参数表示通道号，string型参数表示消息内容
     function<void(int, string)> _notify_message_handler;
 };
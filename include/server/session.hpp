@@ -0,0 +1,43 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <muduo/net/TcpConnection.h>
+#include <boost/any.hpp>
+#include "timingwheel.hpp"
+#include <atomic>
+#include <memory>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 连接的会话状态, 在连接建立时通过TcpConnection::setContext挂到连接上
+// 其它线程上的业务也可能读取接收方连接的会话状态, 所以成员都使用原子变量
+struct Session
+{
+    atomic<bool> binaryProto{false}; // 该连接在登录时是否协商使用二进制聊天消息协议
+    atomic<int> userid{-1};          // 在该连接上登录的用户id, 未登录为-1
+    atomic<bool> throttled{false};   // 发送缓冲区超过预算(慢消费者), 新消息暂存为离线消息, 缓冲区发送完后恢复
+
+    // 离线消息分批下发的进度, 只在该用户的业务线程中访问
+    // offlineSentId > offlineAckedId 表示有一批离线消息已发出、正在等待客户端确认
+    int64_t offlineSentId = 0;  // 已发送的最后一条离线消息的id
+    int64_t offlineAckedId = 0; // 客户端已确认的最后一条离线消息的id
+
+    TimingWheel::WeakEntryPtr idleEntry; // 该连接在空闲检测时间轮中的条目, 只在连接所在的IO线程中访问
+    bool rejected = false;               // 该连接超出准入预算, 已通知客户端稍后重试, 忽略其后续消息, 只在连接所在的IO线程中访问
+};
+
+using SessionPtr = shared_ptr<Session>;
+
+// 获取连接上挂的会话状态, 连接建立前或已被清理时返回空指针
+inline SessionPtr getSession(const TcpConnectionPtr &con)
+{
+    const boost::any &context = con->getContext();
+    if (context.empty())
+    {
+        return SessionPtr();
+    }
+    return *boost::any_cast<SessionPtr>(&context);
+}
+
+#endif
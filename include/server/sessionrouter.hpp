@@ -0,0 +1,108 @@
+#ifndef SESSIONROUTER_H
+#define SESSIONROUTER_H
+
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "chatcodec.hpp"
+#include "mpscqueue.hpp"
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+/*
+按用户划分归属IO线程的会话路由(可选模式, 配置项home_loops)
+每个用户按 userid % IO线程数 固定归属一个IO线程(home loop), 该用户的 userid => 连接 只记录在
+归属线程的会话表中, 会话表只由归属线程访问, 不需要任何锁
+其它线程对会话表的登记、注销和投递都以命令的形式放入归属线程的无锁MPSC队列, 由归属线程依次执行,
+会话表本身不需要锁; 但唤醒归属线程用的是EventLoop::queueInLoop, 它会短暂地持有muduo的pendingFunctors互斥锁,
+每轮drain只提交一次
+muduo在accept时就决定了连接所在的IO线程, 不能迁移, 所以用户的归属线程不一定是其连接所在的线程:
+- 归属线程就是连接所在的线程时, 消息在drain结束时直接按连接合并发送, 不再经过任何队列
+- 否则经连接所在IO线程的DeliveryQueue发送(同样要queueInLoop一次)
+投递在归属线程中完成, 不再回到发送者的IO线程
+*/
+class SessionRouter
+{
+public:
+    // 在归属线程中为在线用户userid的连接con生成要发送的消息帧, 返回空表示不发送
+    using SendCallback = function<FramePtr(int userid, const TcpConnectionPtr &con)>;
+    // 不在本服务器上的用户id
+    using MissingCallback = function<void(vector<int> &missing)>;
+
+    // 获取单例对象的接口函数
+    static SessionRouter *instance();
+
+    // 按IO线程总数创建分片, 在服务器启动前调用, numLoops为0表示不启用
+    void init(size_t numLoops);
+
+    // 是否启用了该模式
+    bool enabled() const { return !_shards.empty(); }
+
+    // IO线程启动时调用, 把编号为index的分片绑定到该线程的EventLoop
+    void bindLoop(size_t index, EventLoop *loop);
+
+    // 可在任意线程调用: 在用户的归属线程中登记用户userid的连接
+    void registerSession(int userid, const TcpConnectionPtr &con);
+
+    // 可在任意线程调用: 注销用户userid, con不为空时只有登记的仍是con才注销
+    void unregisterSession(int userid, const TcpConnectionPtr &con);
+
+    // 可在任意线程调用: 在各个用户的归属线程中查找它们的连接, 对在线的用户调用send并发送它返回的消息帧,
+    // 所有归属线程都处理完后, missing在最后完成的那个IO线程中被调用一次, 参数为空时也会调用
+    void deliver(const vector<int> &userids, SendCallback send, MissingCallback missing);
+
+private:
+    SessionRouter() = default;
+
+    // 一次跨多个分片的投递, 每个分片写自己的不在线用户, 最后一个完成的分片合并结果
+    struct DeliverBatch
+    {
+        SendCallback send;
+        MissingCallback missing;
+        vector<vector<int>> parts;
+        atomic<size_t> remaining{0};
+    };
+
+    // 放入分片队列的命令
+    struct Command
+    {
+        enum Type
+        {
+            REGISTER,
+            UNREGISTER,
+            DELIVER,
+        };
+        Type type = DELIVER;
+        int userid = -1;
+        TcpConnectionPtr con;
+        vector<int> userids;              // DELIVER: 归属于该分片的用户id
+        shared_ptr<DeliverBatch> batch;   // DELIVER: 所属的投递
+        size_t part = 0;                  // DELIVER: 不在线用户写入batch->parts的下标
+    };
+
+    // 一个IO线程的会话表和命令队列
+    struct Shard
+    {
+        atomic<EventLoop *> loop{nullptr};
+        MpscQueue<Command> mailbox;
+        atomic<bool> drainQueued{false}; // 是否已经向loop提交了drain任务
+        unordered_map<int, TcpConnectionPtr> sessions; // 只在loop线程中访问
+    };
+
+    size_t shardOf(int userid) const { return static_cast<size_t>(userid) % _shards.size(); }
+
+    // 把命令放入分片的队列, 必要时唤醒分片所在的IO线程
+    void post(Shard &shard, Command command);
+
+    // 在分片所在的IO线程中执行队列中的所有命令
+    void drain(Shard *shard);
+
+    vector<unique_ptr<Shard>> _shards;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+/*
+踢掉空闲连接的时间轮, 每个IO线程一个, 只在所属的IO线程中访问
+时间轮有idleSeconds个桶, 每秒前进一格, 连接每收到一条消息(包括心跳)就把它的Entry放进当前的桶里
+Entry是引用计数的, 一个连接在最近idleSeconds秒内出现过的所有桶都持有它的Entry,
+当最后一个持有它的桶被清空时Entry析构, 说明该连接已经空闲了idleSeconds秒, 于是关闭连接
+每条消息的开销是一次哈希集合插入, 不需要为每个连接单独创建定时器
+*/
+class TimingWheel
+{
+public:
+    // 时间轮中的连接条目, 析构时关闭仍然存在的连接
+    struct Entry
+    {
+        explicit Entry(const TcpConnectionPtr &con) : weakConn(con) {}
+        ~Entry();
+
+        weak_ptr<TcpConnection> weakConn;
+    };
+    using EntryPtr = shared_ptr<Entry>;
+    using WeakEntryPtr = weak_ptr<Entry>;
+
+    // idleSeconds为0时不启用, touch和tick都是空操作
+    TimingWheel(EventLoop *loop, int idleSeconds);
+
+    TimingWheel(const TimingWheel &) = delete;
+    TimingWheel &operator=(const TimingWheel &) = delete;
+
+    // 新连接建立时调用, 返回该连接的Entry, 由调用者以弱引用的形式保存在连接上
+    WeakEntryPtr add(const TcpConnectionPtr &con);
+
+    // 连接收到消息时调用, 刷新它的空闲时间
+    void touch(const WeakEntryPtr &weakEntry);
+
+private:
+    // 每秒执行一次, 前进一格并清空最旧的桶
+    void onTick();
+
+    using Bucket = unordered_set<EntryPtr>;
+
+    int _idleSeconds;
+    vector<Bucket> _buckets; // 环形缓冲区
+    size_t _tail;            // 当前(最新)的桶的下标
+};
+
+#endif
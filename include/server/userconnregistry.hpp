@@ -0,0 +1,54 @@
+#ifndef USERCONNREGISTRY_H
+#define USERCONNREGISTRY_H
+
+#include <muduo/net/TcpConnection.h>
+#include <array>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+/*
+在线用户的连接表, 按用户id分成多个分段, 每个分段有自己的读写锁
+原来的单个互斥锁被每次登录、注销、聊天投递和redis回调争抢, 分段之后不同用户的操作基本不会互相等待,
+投递消息只查找连接, 用读锁, 多个线程可以同时查找同一个分段
+锁只在访问容器期间持有, 调用者拿到连接之后再在锁外发送消息或访问数据库
+*/
+class UserConnRegistry
+{
+public:
+    // 记录用户userid的连接, 已存在时覆盖
+    void insert(int userid, const TcpConnectionPtr &con);
+
+    // 删除用户userid的连接
+    void erase(int userid);
+
+    // 查找用户userid的连接, 不在本服务器上时返回空指针
+    TcpConnectionPtr find(int userid) const;
+
+    // 批量查找, 在本服务器上的用户及其连接放入found, 其余用户id放入missing
+    // 同一分段的用户只加锁一次
+    void findMany(const vector<int> &userids, vector<pair<int, TcpConnectionPtr>> &found, vector<int> &missing) const;
+
+    // 用户userid的连接仍是con时才删除, 返回是否删除
+    // 断线清理时使用, 避免误删该用户在新连接上重新登录后记录的连接
+    bool eraseIf(int userid, const TcpConnectionPtr &con);
+
+private:
+    static const size_t kStripes = 64; // 分段数量
+
+    // 每个分段单独占一个缓存行, 避免不同分段的锁之间伪共享
+    struct alignas(64) Stripe
+    {
+        mutable shared_mutex mtx;
+        unordered_map<int, TcpConnectionPtr> conns;
+    };
+
+    static size_t stripeOf(int userid) { return static_cast<size_t>(userid) % kStripes; }
+
+    array<Stripe, kStripes> _stripes;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <muduo/base/Timestamp.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+using namespace muduo;
+
+/*
+业务线程池, 业务处理函数中有阻塞的MySQL、Redis调用, 放在IO线程中执行时一条慢查询会卡住该IO线程上的所有连接
+每个工作线程有自己的任务队列, 任务按key(用户id)分片到固定的工作线程上,
+同一个用户的请求总是在同一个线程中按提交顺序执行
+业务处理完成后的响应通过ChatCodec::send交回连接所在的IO线程发送
+*/
+class WorkerPool
+{
+public:
+    using Task = function<void()>;
+
+    WorkerPool() = default;
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // 启动numThreads个工作线程, 为0时不启动线程, 任务直接在提交者的线程中执行
+    void start(int numThreads);
+
+    // 停止并回收所有工作线程, 已经提交的任务会执行完
+    void stop();
+
+    // 可在任意线程调用: 把任务交给key对应的工作线程
+    void submit(size_t key, Task task);
+
+    // 工作线程的数量
+    size_t size() const { return _workers.size(); }
+
+private:
+    struct Worker
+    {
+        mutex mtx;
+        condition_variable cond;
+        deque<pair<Task, Timestamp>> tasks; // 任务及其提交时间
+        bool stopping = false;
+        thread thr;
+    };
+
+    // 工作线程的主循环
+    static void run(Worker *worker);
+
+    vector<unique_ptr<Worker>> _workers;
+};
+
+#endif
@@ -17,6 +17,7 @@
 #include <chrono>
 #include <ctime>
 #include <functional>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -34,6 +35,7 @@ using json = nlohmann::json;
 #include "group.hpp"
 #include "user.hpp"
 #include "public.hpp"
+#include "binaryproto.hpp"
 
 // 记录当前系统登录的用户信息
 User g_currentUser;
@@ -41,18 +43,34 @@ User g_currentUser;
 vector<User> g_currentUserFriendList;
 // 记录当前登录用户的群组列表信息
 vector<Group> g_currentUserGroupList;
+// 登录时是否与服务器协商使用二进制格式的聊天消息
+bool g_binaryProto = false;
 // 控制主菜单页面程序
 bool isMainMenuRunning = false;
+// 下一个请求的id, 服务器在响应中原样回填, 用于匹配请求和响应
+int64_t g_nextReqId = 1;
 
 
 // 接收线程
 void readTaskHandler(int clientfd);
+// 心跳线程
+void heartbeatTaskHandler(int clientfd);
+// 按 长度头+消息体 的帧格式发送一条消息
+int sendFrame(int clientfd, const string &msg);
+// 接收一个完整的消息帧
+int recvFrame(int clientfd, string &msg);
+// 接收请求reqId的响应帧
+int recvResponse(int clientfd, int64_t reqId, string &msg);
 // 获取系统时间（聊天信息需要添加时间信息）
 string getCurrentTime();
 // 主聊天页面程序
 void mainMenu(int);
 // 显示当前登录成功用户的基本信息
 void showCurrentUserData();
+// 显示一批离线消息
+void showOfflineMessages(const json &msgs);
+// 确认已收到lastId及之前的所有离线消息, 服务器删除它们并发送下一批
+void ackOfflineMessages(int clientfd, int64_t lastId);
 
 // 聊天客户端程序实现，main线程用作发送线程，子线程用作接收线程
 int main(int argc, char **argv)
@@ -91,6 +109,10 @@ int main(int argc, char **argv)
         exit(-1);
     }
 
+    // 启动心跳线程, 定期发送心跳消息, 防止用户长时间不操作时连接被服务器当作失联连接关闭
+    std::thread heartbeatTask(heartbeatTaskHandler, clientfd);
+    heartbeatTask.detach();
+
     // main线程用于接收用户输入，负责发送数据
     for (;;)
     {
@@ -121,23 +143,26 @@ int main(int argc, char **argv)
             js["msgId"] = LOGIN_MSG;
             js["id"] = id;
             js["password"] = pwd;
+            js["binary"] = true;        // 声明支持二进制格式的聊天消息
+            int64_t reqId = g_nextReqId++;
+            js["reqId"] = reqId;        // 请求id, 服务器在登录响应中原样回填
             string request = js.dump(); // 将输入的id和password信息序列化成json字符串
 
             // 通过 clientfd 套接字发送字符串request
             // 若request字符串发送成功,send函数返回发送的字节数给len,否则返回-1
-            int len = send(clientfd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            int len = sendFrame(clientfd, request);
             if (len == -1) // 登录消息发送失败
             {
                 cerr << "send login msg error:" << request << endl;
             }
             else // 登录消息发送成功
             {
-                char buffer[1024] = {0}; // 存储通过套接字接收到的json字符串数据
+                string buffer; // 存储通过套接字接收到的json字符串数据
 
-                // 从 clientfd 套接字接收数据(最多1024字节), 并存储到buffer中
-                // 若接收成功,recv函数返回接收的字节数给len,否则返回-1
-                len = recv(clientfd, buffer, 1024, 0);
-                if (len == -1)
+                // 从 clientfd 套接字接收登录请求对应的消息帧, 并存储到buffer中
+                // 若接收成功,recvResponse函数返回帧的字节数给len,对端关闭返回0,出错返回-1
+                len = recvResponse(clientfd, reqId, buffer);
+                if (len <= 0)
                 {
                     cerr << "recv login response error" << endl;
                 }
@@ -147,6 +172,15 @@ int main(int argc, char **argv)
                     if (responsejs["errno"].get<int>() != 0) // 错误号不为0, 登录失败
                     {
                         cerr << responsejs["errmsg"] << endl;
+                        if (responsejs.contains("retryAfter")) // 服务器繁忙, 提示用户稍后重试
+                        {
+                            cerr << "retry after " << responsejs["retryAfter"].get<int>() << " ms" << endl;
+                        }
+                        if (responsejs["msgId"].get<int>() == SERVER_BUSY_MSG) // 连接已被服务器关闭
+                        {
+                            close(clientfd);
+                            exit(-1);
+                        }
                     }
                     else // 登录成功
                     {
@@ -154,6 +188,9 @@ int main(int argc, char **argv)
                         g_currentUser.setId(responsejs["id"].get<int>());
                         g_currentUser.setName(responsejs["name"]);
 
+                        // 记录服务器的协议协商结果, 旧服务器不返回该字段, 继续使用json
+                        g_binaryProto = responsejs.contains("binary") && responsejs["binary"].get<bool>();
+
                         // 记录当前用户的好友列表信息
                         if (responsejs.contains("friends")) // 当前用户有好友
                         {
@@ -209,22 +246,11 @@ int main(int argc, char **argv)
                         // 显示当前用户的离线消息 个人聊天信息或者群组消息
                         if (responsejs.contains("offlinemsg")) // 当前用户有离线消息
                         {
-                            vector<string> vec = responsejs["offlinemsg"];
-                            for (string &str : vec)
+                            // 这是第一批离线消息, 确认后服务器再用OFFLINE_MSG发送下一批
+                            showOfflineMessages(responsejs["offlinemsg"]);
+                            if (responsejs.contains("offlineLastId"))
                             {
-                                json js = json::parse(str);
-                                // time + [id] + name + "said: " + xxx
-                                int msgtype = js["msgId"].get<int>(); // 获取消息类型(单聊或群聊)
-                                if (ONE_CHAT_MSG == msgtype)   // 一对一聊天消息
-                                {
-                                    cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                                         << " said: " << js["msg"].get<string>() << endl;
-                                }
-                                else  // 群聊消息
-                                {
-                                    cout << "群组[" << js["groupid"] << "]消息:" << js["time"].get<string>() << " [" << js["id"] << "]" 
-                                         << js["name"].get<string>() << " said: " << js["msg"].get<string>() << endl;
-                                }
+                                ackOfflineMessages(clientfd, responsejs["offlineLastId"].get<int64_t>());
                             }
                         }
 
@@ -259,18 +285,20 @@ int main(int argc, char **argv)
             js["msgId"] = REG_MSG;
             js["name"] = name;
             js["password"] = pwd;
+            int64_t reqId = g_nextReqId++;
+            js["reqId"] = reqId;
             string request = js.dump();
 
-            int len = send(clientfd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            int len = sendFrame(clientfd, request);
             if (len == -1)
             {
                 cerr << "send reg msg error:" << request << endl;
             }
             else
             {
-                char buffer[1024] = {0};
-                len = recv(clientfd, buffer, 1024, 0);
-                if (-1 == len)
+                string buffer;
+                len = recvResponse(clientfd, reqId, buffer);
+                if (len <= 0)
                 {
                     cerr << "recv reg response error" << endl;
                 }
@@ -302,21 +330,154 @@ int main(int argc, char **argv)
     return 0;
 }
 
+// 按 4字节长度头(网络字节序) + 消息体 的帧格式发送一条消息, 与服务器的ChatCodec对应
+// 成功返回消息体的字节数, 失败返回-1
+int sendFrame(int clientfd, const string &msg)
+{
+    uint32_t len = htonl(msg.size());
+    string frame(reinterpret_cast<const char *>(&len), sizeof(len));
+    frame += msg;
+
+    // main线程和心跳线程都会发送消息, 加锁保证一帧数据不会被另一帧打断
+    static mutex sendMutex;
+    lock_guard<mutex> lock(sendMutex);
+
+    size_t sent = 0;
+    while (sent < frame.size()) // send可能只发送了部分数据, 循环直到整帧发送完毕
+    {
+        int n = send(clientfd, frame.data() + sent, frame.size() - sent, 0);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        sent += n;
+    }
+    return msg.size();
+}
+
+// 心跳线程, 每30秒发送一次心跳消息(服务器默认120秒没有收到任何消息就关闭连接)
+void heartbeatTaskHandler(int clientfd)
+{
+    json js;
+    js["msgId"] = HEARTBEAT_MSG;
+    string request = js.dump();
+
+    for (;;)
+    {
+        this_thread::sleep_for(chrono::seconds(30));
+        if (sendFrame(clientfd, request) == -1)
+        {
+            return; // 连接已断开
+        }
+    }
+}
+
+// 从套接字中读满n个字节, 成功返回n, 对端关闭返回0, 出错返回-1
+static int recvAll(int clientfd, char *buf, size_t n)
+{
+    size_t got = 0;
+    while (got < n)
+    {
+        int len = recv(clientfd, buf + got, n - got, 0);
+        if (len <= 0)
+        {
+            return len;
+        }
+        got += len;
+    }
+    return n;
+}
+
+// 接收一个完整的消息帧, 成功返回包括长度头在内的帧字节数(消息体可以为空, 返回值至少为4), 对端关闭返回0, 出错返回-1
+int recvFrame(int clientfd, string &msg)
+{
+    uint32_t len = 0;
+    int n = recvAll(clientfd, reinterpret_cast<char *>(&len), sizeof(len)); // 先读长度头
+    if (n <= 0)
+    {
+        return n;
+    }
+
+    msg.resize(ntohl(len));
+    if (msg.empty()) // 空的消息帧也是一个完整的帧
+    {
+        return n;
+    }
+    int m = recvAll(clientfd, &msg[0], msg.size()); // 再按长度读消息体
+    return m <= 0 ? m : n + m;
+}
+
+// 接收请求reqId的响应帧, 返回值同recvFrame
+// 一个连接上可以同时有多个请求在处理中, 服务器按完成的先后发送响应, 跳过reqId不匹配的帧
+// 不回填reqId的旧服务器一次只处理一个请求, 收到的第一个json帧就是响应
+int recvResponse(int clientfd, int64_t reqId, string &msg)
+{
+    for (;;)
+    {
+        int len = recvFrame(clientfd, msg);
+        if (len <= 0)
+        {
+            return len;
+        }
+        if (isBinaryMsg(msg)) // 二进制帧只用于聊天消息, 不会是响应
+        {
+            continue;
+        }
+
+        json js = json::parse(msg, nullptr, false);
+        if (js.is_discarded())
+        {
+            continue;
+        }
+        if (!js.contains("reqId") || js["reqId"].get<int64_t>() == reqId)
+        {
+            return len;
+        }
+    }
+}
+
 // 接收线程
 void readTaskHandler(int clientfd)
 {
     for (;;)
     {
-        char buffer[1024] = {0};                   // 存储接收的数据
-        int len = recv(clientfd, buffer, 1024, 0); // 阻塞了
+        string buffer;                        // 存储接收的数据
+        int len = recvFrame(clientfd, buffer); // 阻塞了
         if (-1 == len || 0 == len)
         {
             close(clientfd);
             exit(-1);
         }
 
-        // 接收ChatServer转发的数据，反序列化生成json数据对象
-        json js = json::parse(buffer);
+        // 二进制格式的聊天消息
+        if (isBinaryMsg(buffer))
+        {
+            ChatMessage msg;
+            if (!decodeBinaryMsg(buffer, msg))
+            {
+                cerr << "invalid binary message!" << endl;
+                continue;
+            }
+
+            if (ONE_CHAT_MSG == msg.msgId) // 一对一聊天
+            {
+                cout << formatChatTime(msg.time) << " [" << msg.fromid << "]" << msg.name
+                     << " said: " << msg.msg << endl;
+            }
+            else if (GROUP_CHAT_MSG == msg.msgId) // 群聊
+            {
+                cout << "群组[" << msg.groupid << "]消息:" << formatChatTime(msg.time) << " [" << msg.fromid << "]" << msg.name
+                     << " said: " << msg.msg << endl;
+            }
+            continue;
+        }
+
+        // 接收ChatServer转发的数据，反序列化生成json数据对象, 空帧或无法解析的数据直接忽略
+        json js = json::parse(buffer, nullptr, false);
+        if (js.is_discarded() || !js.is_object())
+        {
+            continue;
+        }
         int msgtype = js["msgId"].get<int>();
         if (ONE_CHAT_MSG == msgtype)   // 一对一聊天
         {
@@ -331,6 +492,46 @@ void readTaskHandler(int clientfd)
                  << " said: " << js["msg"].get<string>() << endl;
             continue;
         }
+
+        if (OFFLINE_MSG == msgtype) // 下一批离线消息
+        {
+            showOfflineMessages(js["msgs"]);
+            ackOfflineMessages(clientfd, js["lastId"].get<int64_t>());
+            continue;
+        }
+    }
+}
+
+// 显示一批离线消息 个人聊天信息或者群组消息
+void showOfflineMessages(const json &msgs)
+{
+    for (const auto &item : msgs)
+    {
+        json js = json::parse(item.get<string>());
+        // time + [id] + name + "said: " + xxx
+        int msgtype = js["msgId"].get<int>(); // 获取消息类型(单聊或群聊)
+        if (ONE_CHAT_MSG == msgtype)   // 一对一聊天消息
+        {
+            cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
+                 << " said: " << js["msg"].get<string>() << endl;
+        }
+        else  // 群聊消息
+        {
+            cout << "群组[" << js["groupid"] << "]消息:" << js["time"].get<string>() << " [" << js["id"] << "]" 
+                 << js["name"].get<string>() << " said: " << js["msg"].get<string>() << endl;
+        }
+    }
+}
+
+// 确认已收到lastId及之前的所有离线消息
+void ackOfflineMessages(int clientfd, int64_t lastId)
+{
+    json js;
+    js["msgId"] = OFFLINE_MSG_ACK;
+    js["lastId"] = lastId;
+    if (sendFrame(clientfd, js.dump()) == -1)
+    {
+        cerr << "send offline ack error" << endl;
     }
 }
 
@@ -460,7 +661,7 @@ void addfriend(int clientfd, string str)
     js["friendid"] = friendid;        // 待添加的好友id
     string buffer = js.dump();        // 序列化json数据
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0); // 发送数据
+    int len = sendFrame(clientfd, buffer); // 发送数据
     if (-1 == len)
     {
         cerr << "send addfriend msg error -> " << buffer << endl;
@@ -487,9 +688,14 @@ void chat(int clientfd, string str)
     js["toid"] = friendid;                // 聊天的好友id
     js["msg"] = message;                  // 聊天内容
     js["time"] = getCurrentTime();        // 获取发送消息的当前时间
-    string buffer = js.dump();            // 序列化json数据
+    // 协商了二进制协议时, 聊天消息按二进制格式发送, 否则序列化成json
+    string buffer = g_binaryProto ? encodeBinaryMsg(chatMessageFromJson(js)) : string();
+    if (buffer.empty()) // 没有协商二进制协议, 或者用户名过长无法按二进制格式编码
+    {
+        buffer = js.dump();
+    }
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0); // 发送数据
+    int len = sendFrame(clientfd, buffer); // 发送数据
     if (-1 == len)
     {
         cerr << "send chat msg error -> " << buffer << endl;
@@ -516,7 +722,7 @@ void creategroup(int clientfd, string str)
     js["groupdesc"] = groupdesc;      // 群组描述
     string buffer = js.dump();        // 序列化json数据
     
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0); // 发送数据
+    int len = sendFrame(clientfd, buffer); // 发送数据
     if (-1 == len)
     {
         cerr << "send creategroup msg error -> " << buffer << endl;
@@ -533,7 +739,7 @@ void addgroup(int clientfd, string str)
     js["groupid"] = groupid;
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendFrame(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send addgroup msg error -> " << buffer << endl;
@@ -560,9 +766,14 @@ void groupchat(int clientfd, string str)
     js["groupid"] = groupid;              // 获取群组id
     js["msg"] = message;                  // 获取当前用户发送的群聊消息内容
     js["time"] = getCurrentTime();        // 获取发送消息的时间
-    string buffer = js.dump();            // 序列化json数据
+    // 协商了二进制协议时, 聊天消息按二进制格式发送, 否则序列化成json
+    string buffer = g_binaryProto ? encodeBinaryMsg(chatMessageFromJson(js)) : string();
+    if (buffer.empty()) // 没有协商二进制协议, 或者用户名过长无法按二进制格式编码
+    {
+        buffer = js.dump();
+    }
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0); // 发送数据
+    int len = sendFrame(clientfd, buffer); // 发送数据
     if (-1 == len)
     {
         cerr << "send groupchat msg error -> " << buffer << endl;
@@ -570,14 +781,14 @@ void groupchat(int clientfd, string str)
 }
 
 // "loginout" command handler
-void loginout(int clientfd, string str)
+void loginout(int clientfd, string)
 {
     json js;
     js["msgId"] = LOGINOUT_MSG;
     js["id"] = g_currentUser.getId(); // 获取当前要注销的用户id
     string buffer = js.dump();        // 序列化json数据
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0); // 发送数据
+    int len = sendFrame(clientfd, buffer); // 发送数据
     if (-1 == len)
     {
         cerr << "send loginout msg error -> " << buffer << endl;
@@ -0,0 +1,158 @@
+#include "admission.hpp"
+#include <muduo/base/Timestamp.h>
+#include <algorithm>
+#include <random>
+using namespace muduo;
+
+// 每个限流器最多记录的来源IP数, 超过后清理令牌已经补满的IP, 清理不出空位时新IP只检查全局令牌桶
+static const size_t kMaxTrackedIps = 10000;
+// 建议客户端重试前等待的最短时间(毫秒)
+static const double kMinRetryMs = 1000;
+
+// 令牌桶的突发容量取速率的2倍
+static double burstOf(double rate)
+{
+    return rate * 2;
+}
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : _rate(rate), _burst(max(burst, 1.0)), _tokens(_burst), _last(0)
+{
+}
+
+// 补充令牌并检查是否有令牌可用
+double TokenBucket::wait(double now)
+{
+    if (_rate <= 0)
+    {
+        return 0;
+    }
+
+    if (_last > 0)
+    {
+        _tokens = min(_burst, _tokens + (now - _last) * _rate);
+    }
+    _last = now;
+    return _tokens >= 1 ? 0 : (1 - _tokens) / _rate;
+}
+
+// 取走一个令牌
+void TokenBucket::take()
+{
+    if (_rate > 0)
+    {
+        _tokens -= 1;
+    }
+}
+
+// 令牌是否已经补满
+bool TokenBucket::full(double now)
+{
+    wait(now);
+    return _tokens >= _burst;
+}
+
+// 获取单例对象的接口函数
+AdmissionControl *AdmissionControl::instance()
+{
+    static AdmissionControl admission;
+    return &admission;
+}
+
+// 按配置设置各个令牌桶的速率
+void AdmissionControl::configure(const ServerConfig &config)
+{
+    configure(_connections, config.connectRate, config.ipRate);
+    configure(_logins, config.loginRate, config.ipRate);
+}
+
+// 设置一类请求的令牌桶速率并清空记录的来源IP
+void AdmissionControl::configure(Limiter &limiter, double rate, double ipRate)
+{
+    lock_guard<mutex> lock(limiter.mtx);
+    limiter.global = TokenBucket(rate, burstOf(rate));
+    limiter.ipRate = ipRate;
+    limiter.ipBurst = burstOf(ipRate);
+    limiter.sweepInterval = ipRate > 0 ? max(1.0, limiter.ipBurst / ipRate) : 1;
+    limiter.lastSweep = 0;
+    limiter.perIp.clear();
+}
+
+// 当前时间(秒)
+double AdmissionControl::now()
+{
+    return static_cast<double>(Timestamp::now().microSecondsSinceEpoch()) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// 新连接的准入检查
+int AdmissionControl::admitConnection(const string &ip, double now)
+{
+    return admit(_connections, ip, now);
+}
+
+// 登录请求的准入检查
+int AdmissionControl::admitLogin(const string &ip, double now)
+{
+    return admit(_logins, ip, now);
+}
+
+// 对一类请求做准入检查
+int AdmissionControl::admit(Limiter &limiter, const string &ip, double now)
+{
+    double waitSeconds = 0;
+    {
+        lock_guard<mutex> lock(limiter.mtx);
+
+        double globalWait = limiter.global.wait(now);
+        auto it = limiter.perIp.end();
+        if (limiter.ipRate > 0)
+        {
+            it = limiter.perIp.find(ip);
+            if (it == limiter.perIp.end())
+            {
+                // 来源IP过多时清理已经补满令牌的IP, 补满的令牌桶与新建的令牌桶等价;
+                // 补满至少需要sweepInterval, 在这之前再扫一遍也清理不出空位, 重连风暴中不会每次都遍历整个表
+                if (limiter.perIp.size() >= kMaxTrackedIps && now - limiter.lastSweep >= limiter.sweepInterval)
+                {
+                    limiter.lastSweep = now;
+                    for (auto sweep = limiter.perIp.begin(); sweep != limiter.perIp.end();)
+                    {
+                        sweep = sweep->second.full(now) ? limiter.perIp.erase(sweep) : ++sweep;
+                    }
+                }
+                if (limiter.perIp.size() < kMaxTrackedIps)
+                {
+                    it = limiter.perIp.emplace(ip, TokenBucket(limiter.ipRate, limiter.ipBurst)).first;
+                }
+            }
+        }
+
+        // 不按IP限流, 或者表已满记录不了这个IP时, 只检查全局令牌桶
+        if (it == limiter.perIp.end())
+        {
+            if (globalWait == 0)
+            {
+                limiter.global.take();
+                return 0;
+            }
+            waitSeconds = globalWait;
+        }
+        else
+        {
+            // 两个桶都有令牌才同时取走, 被拒绝的请求不消耗任何一个桶的令牌
+            double ipWait = it->second.wait(now);
+            if (globalWait == 0 && ipWait == 0)
+            {
+                limiter.global.take();
+                it->second.take();
+                return 0;
+            }
+            waitSeconds = max(globalWait, ipWait);
+        }
+    }
+
+    // 所有被拒绝的客户端如果在同一时刻重试会再次形成风暴, 在建议的等待时间上加随机抖动把重试分散开
+    thread_local mt19937 rng(random_device{}());
+    uniform_real_distribution<double> jitter(1.0, 2.0);
+    return static_cast<int>(max(waitSeconds * 1000, kMinRetryMs) * jitter(rng));
+}
@@ -0,0 +1,121 @@
+#include "chatcodec.hpp"
+#include "loopcontext.hpp"
+#include "binaryproto.hpp"
+#include <muduo/base/Logging.h>
+
+ChatCodec::ChatCodec(const FrameCallback &cb, size_t maxFrameLen)
+    : _frameCallback(cb), _maxFrameLen(maxFrameLen)
+{
+}
+
+// 从buffer中循环解析出所有完整的消息帧
+void ChatCodec::onMessage(const TcpConnectionPtr &con, Buffer *buffer, Timestamp time)
+{
+    FramePtr frame;
+    for (;;)
+    {
+        DecodeResult result = decode(buffer, _maxFrameLen, frame);
+        if (result == kFrameReady)
+        {
+            _frameCallback(con, frame, time);
+        }
+        else if (result == kFrameInvalid)
+        {
+            // 长度非法,后面的数据已无法再正确分帧,只能断开连接
+            LOG_ERROR << con->name() << " invalid frame length " << buffer->peekInt32() << ", shutdown";
+            con->shutdown();
+            break;
+        }
+        else // 半包, 等待剩余数据到达
+        {
+            break;
+        }
+    }
+}
+
+// 从buffer中取出一个完整的帧
+ChatCodec::DecodeResult ChatCodec::decode(Buffer *buffer, size_t maxFrameLen, FramePtr &frame)
+{
+    // 可读数据至少有一个长度头,才可能是一个完整的帧
+    if (buffer->readableBytes() < kHeaderLen)
+    {
+        return kFrameIncomplete;
+    }
+
+    const int32_t len = buffer->peekInt32(); // 只读取长度头,不移动读指针
+    if (len < 0 || static_cast<size_t>(len) > maxFrameLen)
+    {
+        return kFrameInvalid;
+    }
+    if (buffer->readableBytes() < kHeaderLen + len) // 半包
+    {
+        return kFrameIncomplete;
+    }
+
+    buffer->retrieve(kHeaderLen);
+
+    // 兼容旧客户端在json消息末尾多发送的'\0'
+    // 二进制消息的头部字段和消息体都可能以0字节结尾, 不能去掉
+    const char *begin = buffer->peek();
+    int32_t bodyLen = len;
+    if (bodyLen == 0 || static_cast<uint8_t>(begin[0]) != BINARY_MSG_MAGIC)
+    {
+        while (bodyLen > 0 && begin[bodyLen - 1] == '\0')
+        {
+            --bodyLen;
+        }
+    }
+
+    // 消息帧从接收缓冲区中只拷贝这一次, 之后的转发都共享这份数据
+    frame = make_shared<const string>(begin, bodyLen);
+    buffer->retrieve(len);
+    return kFrameReady;
+}
+
+// 给消息加上长度头后写入buffer
+void ChatCodec::encode(const string &message, Buffer *buffer)
+{
+    buffer->appendInt32(static_cast<int32_t>(message.size())); // 网络字节序的长度头
+    buffer->append(message.data(), message.size());
+}
+
+// 给消息加上长度头后发送
+void ChatCodec::send(const TcpConnectionPtr &con, const string &message)
+{
+    send(con, make_shared<const string>(message));
+}
+
+// 不经过投递聚合器立即发送
+void ChatCodec::sendNow(const TcpConnectionPtr &con, const string &message)
+{
+    Buffer buf;
+    encode(message, &buf);
+    con->send(&buf);
+}
+
+// 发送共享的消息帧
+void ChatCodec::send(const TcpConnectionPtr &con, const FramePtr &message)
+{
+    // 交给连接所在EventLoop的投递聚合器, 本轮事件循环结束时和发往该连接的其它消息合并成一次写入
+    // 跨线程投递时只传递智能指针, 避免每个接收方都拷贝一份消息
+    LoopContext *context = getLoopContext(con->getLoop());
+    if (context != nullptr)
+    {
+        context->deliveryQueue.enqueue(con, message);
+        return;
+    }
+
+    // EventLoop没有初始化投递聚合器时, 直接在连接所在的IO线程中发送
+    EventLoop *loop = con->getLoop();
+    if (loop->isInLoopThread())
+    {
+        sendNow(con, *message);
+    }
+    else
+    {
+        loop->runInLoop([con, message]()
+        {
+            sendNow(con, *message);
+        });
+    }
+}
@@ -0,0 +1,67 @@
+#include "chatpayload.hpp"
+#include "session.hpp"
+#include <muduo/base/Logging.h>
+
+// 来自json格式的原始帧, 所有json接收方共享这份数据
+ChatPayload::ChatPayload(const FramePtr &jsonFrame)
+    : _json(jsonFrame)
+{
+}
+
+// 来自二进制格式的原始帧, 所有二进制接收方共享这份数据
+ChatPayload::ChatPayload(const ChatMessage &msg, const FramePtr &binaryFrame)
+    : _msg(msg), _binary(binaryFrame)
+{
+}
+
+// json格式的消息内容
+const FramePtr &ChatPayload::jsonFrame() const
+{
+    call_once(_jsonOnce, [this]()
+    {
+        if (!_json) // 二进制来源的消息, 由消息字段编码
+        {
+            // 二进制消息的内容不保证是合法的UTF-8, 非法字节替换掉, 不让dump抛出异常
+            _json = make_shared<const string>(chatMessageToJson(_msg).dump(-1, ' ', false, json::error_handler_t::replace));
+        }
+    });
+    return _json;
+}
+
+// 二进制格式的消息内容, json消息无法解析时返回空指针
+const FramePtr &ChatPayload::binaryFrame() const
+{
+    call_once(_binaryOnce, [this]()
+    {
+        if (!_binary) // json来源的消息, 需要先转换出消息字段
+        {
+            // 在业务线程或IO线程中调用, 不能让异常传出去; 消息无法解析时丢弃, _binary保持为空
+            json js = json::parse(*_json, nullptr, false);
+            if (js.is_discarded() || !js.is_object())
+            {
+                LOG_ERROR << "invalid json chat message, dropped: " << *_json;
+                return;
+            }
+            _msg = chatMessageFromJson(js);
+            string binary = encodeBinaryMsg(_msg);
+            if (binary.empty()) // 用户名过长, 二进制格式放不下, 二进制客户端同样可以接收json格式
+            {
+                _binary = jsonFrame();
+                return;
+            }
+            _binary = make_shared<const string>(std::move(binary));
+        }
+    });
+    return _binary;
+}
+
+// 按接收方连接协商的协议选择消息格式
+const FramePtr &ChatPayload::frameFor(const TcpConnectionPtr &con) const
+{
+    SessionPtr session = getSession(con);
+    if (session && session->binaryProto)
+    {
+        return binaryFrame();
+    }
+    return jsonFrame();
+}
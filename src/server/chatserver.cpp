@@ -1,58 +1,295 @@
 #include "chatserver.hpp"
 #include "json.hpp"
 #include "chatservice.hpp"
+#include "session.hpp"
+#include "loopcontext.hpp"
+#include "metrics.hpp"
+#include "admission.hpp"
+#include "sessionrouter.hpp"
+#include "binaryproto.hpp"
+#include "public.hpp"
+#include <muduo/base/Logging.h>
+#include <muduo/base/CurrentThread.h>
 #include <functional>
 #include <string>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
 using namespace std;
 using namespace placeholders;
 using json = nlohmann::json;
 
+// 被准入控制拒绝的连接在发送SERVER_BUSY之后最多保留的秒数, 客户端不主动关闭时由服务器强制关闭
+static const double kRejectedCloseDelay = 2.0;
+
+// 将当前线程绑定到指定的CPU上
+static bool bindCurrentThreadToCpu(int cpu)
+{
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    if (ret != 0)
+    {
+        LOG_ERROR << "bind thread " << CurrentThread::tid() << " to cpu " << cpu << " failed, errno " << ret;
+        return false;
+    }
+    return true;
+}
+
 // 初始化聊天服务器对象
 ChatServer::ChatServer(EventLoop *loop,
                        const InetAddress &listenAddr,
-                       const string &nameArg)
-    : _server(loop, listenAddr, nameArg), _loop(loop)
+                       const string &nameArg,
+                       const ServerConfig &config,
+                       int acceptorIndex)
+    : _server(loop, listenAddr, nameArg, config.acceptors > 1 ? TcpServer::kReusePort : TcpServer::kNoReusePort),
+      _loop(loop),
+      _codec(std::bind(&ChatServer::onFrame, this, _1, _2, _3)),
+      _config(config),
+      _acceptorIndex(acceptorIndex),
+      _nextIoThread(0)
 {
     // 注册链接回调
     _server.setConnectionCallback(std::bind(&ChatServer::onConnection, this, _1));
 
-    // 注册消息回调
-    _server.setMessageCallback(std::bind(&ChatServer::onMessage, this, _1, _2, _3));
+    // 注册消息回调, 先交给编解码器分帧, 每个完整的帧再上报给onFrame
+    _server.setMessageCallback(std::bind(&ChatCodec::onMessage, &_codec, _1, _2, _3));
+
+    // 注册发送缓冲区清空的回调, 用于解除慢消费者的限流状态
+    _server.setWriteCompleteCallback(std::bind(&ChatServer::onWriteComplete, this, _1));
 
-    // 设置线程数量
-    _server.setThreadNum(4);
+    // 注册IO线程初始化回调
+    _server.setThreadInitCallback(std::bind(&ChatServer::onThreadInit, this, _1));
+
+    // 设置线程数量, 默认与CPU核数相同, 多个acceptor时平均分配
+    _server.setThreadNum(_config.ioThreadsPerAcceptor());
 }
 
-// 启动服务
+// 启动服务, 在acceptor所在的线程中调用
 void ChatServer::start()
 {
+    // acceptor线程负责accept新连接, 按配置绑定CPU
+    if (!_config.acceptorCpus.empty())
+    {
+        bindCurrentThreadToCpu(_config.acceptorCpus[_acceptorIndex % _config.acceptorCpus.size()]);
+    }
+
+    // 启动所有IO线程并开始监听, 返回时每个IO线程的初始化回调都已执行完毕
     _server.start();
+
+    reportThreadLayout();
+
+    // 周期性地输出运行指标, 指标是全局的, 只由第一个acceptor输出
+    if (_acceptorIndex == 0)
+    {
+        _loop->runEvery(_config.metricsInterval, []()
+        {
+            LOG_INFO << "metrics: " << Metrics::instance()->report();
+        });
+    }
+}
+
+// IO线程启动时的初始化回调, 在该IO线程中执行, 早于该EventLoop上的任何连接事件
+void ChatServer::onThreadInit(EventLoop *loop)
+{
+    // IO线程按全局编号依次绑定io_cpus中的CPU, 线程多于CPU时循环使用
+    int index = _acceptorIndex * _config.ioThreadsPerAcceptor() + _nextIoThread++;
+    int cpu = -1;
+    if (!_config.ioCpus.empty())
+    {
+        cpu = _config.ioCpus[index % _config.ioCpus.size()];
+        if (!bindCurrentThreadToCpu(cpu))
+        {
+            cpu = -1;
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(_loopCpuMutex);
+        _loopCpus.push_back({index, cpu});
+    }
+
+    loop->setContext(make_shared<LoopContext>(loop, _config.idleTimeout));
+
+    // 编号为index的会话表分片由本IO线程负责
+    SessionRouter::instance()->bindLoop(index, loop);
+}
+
+// 输出IO线程与CPU的对应关系
+void ChatServer::reportThreadLayout()
+{
+    lock_guard<mutex> lock(_loopCpuMutex);
+    sort(_loopCpus.begin(), _loopCpus.end());
+
+    LOG_INFO << _server.name() << " listen on " << _server.ipPort()
+             << ", io threads " << _loopCpus.size()
+             << ", output budget " << _config.outputBudget << " bytes"
+             << ", idle timeout " << _config.idleTimeout << "s";
+    string acceptorCpu = "any";
+    if (!_config.acceptorCpus.empty())
+    {
+        acceptorCpu = to_string(_config.acceptorCpus[_acceptorIndex % _config.acceptorCpus.size()]);
+    }
+    LOG_INFO << "acceptor " << _acceptorIndex << " loop => cpu " << acceptorCpu;
+    for (auto &item : _loopCpus)
+    {
+        LOG_INFO << "io loop " << item.first << " => cpu " << (item.second >= 0 ? to_string(item.second) : "any");
+    }
 }
 
 // 上报链接相关信息的回调函数
 void ChatServer::onConnection(const TcpConnectionPtr &con)
 {
+    // 客户端建立连接, 挂上该连接的会话状态
+    if (con->connected())
+    {
+        Metrics::instance()->acceptedConnections++;
+        SessionPtr session = make_shared<Session>();
+        con->setContext(session);
+
+        // 加入本IO线程的空闲检测时间轮
+        session->idleEntry = getLoopContext(con->getLoop())->timingWheel.add(con);
+
+        // 超出新连接的准入预算, 告知客户端稍后重试并关闭连接, 而不是让它排队等待
+        int retryAfter = AdmissionControl::instance()->admitConnection(con->peerAddress().toIp());
+        if (retryAfter > 0)
+        {
+            Metrics::instance()->rejectedConnections++;
+            session->rejected = true;
+
+            json response;
+            response["msgId"] = SERVER_BUSY_MSG;
+            response["errno"] = 4;
+            response["errmsg"] = "server is busy, please retry later!";
+            response["retryAfter"] = retryAfter;
+            ChatCodec::sendNow(con, response.dump()); // 马上就要shutdown, 不能等投递聚合器flush
+            con->shutdown(); // 发送完缓冲区中的数据后关闭写端
+            // 只关闭写端时, 不关闭连接的客户端会一直占用fd(idle_timeout为0时时间轮也不会关闭它), 延迟一段时间后强制关闭
+            con->forceCloseWithDelay(kRejectedCloseDelay);
+            return;
+        }
+
+        // 发送缓冲区超过预算时回调onHighWaterMark, 防止一个卡住的客户端让服务器内存无限增长
+        con->setHighWaterMarkCallback(std::bind(&ChatServer::onHighWaterMark, this, _1, _2), _config.outputBudget);
+    }
     // 客户端断开连接
-    if (!con->connected())
+    else
     {
+        // 限流中的连接断开, 从限流连接数中减去
+        SessionPtr session = getSession(con);
+        if (session && session->throttled.exchange(false))
+        {
+            Metrics::instance()->throttledConnections--;
+        }
+
         ChatService::instance()->clientCloseException(con);
         con->shutdown();
     }
 }
 
-// 上报读写事件相关信息的回调函数
-void ChatServer::onMessage(const TcpConnectionPtr &con, // 当前的连接
-                           Buffer *buffer,              // 接收到的数据缓冲区
-                           Timestamp time)              // 接收到数据的时间信息
+// 连接的发送缓冲区超过预算的回调函数, 在连接所在的IO线程中执行
+void ChatServer::onHighWaterMark(const TcpConnectionPtr &con, size_t len)
 {
-    string buf = buffer->retrieveAllAsString();
-    
+    SessionPtr session = getSession(con);
+    if (session && !session->throttled.exchange(true))
+    {
+        LOG_WARN << con->name() << " output buffer " << len << " bytes exceeds budget, throttled";
+        Metrics::instance()->throttledConnections++;
+        Metrics::instance()->throttleEvents++;
+    }
+}
+
+// 连接的发送缓冲区全部发送完毕的回调函数, 在连接所在的IO线程中执行
+void ChatServer::onWriteComplete(const TcpConnectionPtr &con)
+{
+    SessionPtr session = getSession(con);
+    if (session && session->throttled)
+    {
+        // 补发限流期间转存的离线消息后解除限流
+        ChatService::instance()->resumeDelivery(con);
+        LOG_INFO << con->name() << " output buffer drained, resume delivery";
+    }
+}
+
+// 编解码器上报完整消息帧的回调函数
+void ChatServer::onFrame(const TcpConnectionPtr &con, // 当前的连接
+                         const FramePtr &frame,       // 一个完整的消息帧(不含长度头)
+                         Timestamp time)              // 接收到数据的时间信息
+{
+    // 收到任何消息都刷新该连接的空闲时间, O(1)操作
+    // 被拒绝的连接不再处理任何消息, 也不刷新空闲时间, 客户端不关闭连接时在延迟之后被强制关闭
+    SessionPtr session = getSession(con);
+    if (session && session->rejected)
+    {
+        return;
+    }
+    if (session)
+    {
+        getLoopContext(con->getLoop())->timingWheel.touch(session->idleEntry);
+    }
+
+    // 二进制格式的聊天消息, 不经过json解析, 直接交给业务层
+    if (isBinaryMsg(*frame))
+    {
+        ChatMessage msg;
+        if (!decodeBinaryMsg(*frame, msg))
+        {
+            LOG_ERROR << con->name() << " invalid binary message frame, dropped";
+            return;
+        }
+
+        // 只接受已登录并协商了二进制协议的连接发来的、以自己的身份发送的二进制消息
+        int userid = session ? session->userid.load() : -1;
+        if (userid == -1 || !session->binaryProto || msg.fromid != userid)
+        {
+            LOG_ERROR << con->name() << " binary message from user " << msg.fromid
+                      << " without login or negotiation, dropped";
+            return;
+        }
+        ChatService::instance()->binaryChat(con, msg, frame, time);
+        return;
+    }
+
     // 数据的反序列化, 解析出的数据中包含一个事件的id号(在public.hpp中定义的事件id),标识这个事件
-    json js = json::parse(buf);
-    
+    // 不抛异常的解析方式, 单个非法帧只丢弃该帧, 不影响连接上的后续消息
+    json js = json::parse(*frame, nullptr, false);
+    if (js.is_discarded() || !js.contains("msgId") || !js["msgId"].is_number_integer())
+    {
+        LOG_ERROR << con->name() << " invalid message frame, dropped: " << *frame;
+        return;
+    }
+
+    // 心跳消息只用于刷新空闲时间, 不需要交给业务层
+    if (js["msgId"].get<int>() == HEARTBEAT_MSG)
+    {
+        return;
+    }
+
+    // 超出登录请求的准入预算, 直接回复登录失败并告知客户端稍后重试, 不访问数据库
+    if (js["msgId"].get<int>() == LOGIN_MSG)
+    {
+        int retryAfter = AdmissionControl::instance()->admitLogin(con->peerAddress().toIp());
+        if (retryAfter > 0)
+        {
+            Metrics::instance()->rejectedLogins++;
+
+            json response;
+            response["msgId"] = LOGIN_MSG_ACK;
+            response["errno"] = 4;
+            response["errmsg"] = "server is busy, please retry later!";
+            response["retryAfter"] = retryAfter;
+            if (js.contains("reqId")) // 回填客户端的请求id
+            {
+                response["reqId"] = js["reqId"];
+            }
+            ChatCodec::send(con, response.dump());
+            return;
+        }
+    }
+
     // 目的: 完全解耦网络模块的代码和业务模块的代码
-    // 通过js["msgId"]获取对应的业务处理器handler => con、js、time
-    auto msgHandler = ChatService::instance()->getHandler(js["msgId"].get<int>());
-    // 回调消息绑定好的事件处理器,来进行相应的业务处理
-    msgHandler(con, js, time);
+    // 通过js["msgId"]在分发表中找到对应的业务处理函数, 由它把json解码成类型化的请求后进行相应的业务处理,
+    // 原始的消息帧一并传入, 转发类业务可以直接复用
+    ChatService::instance()->dispatch(js["msgId"].get<int>(), con, js, frame, time);
 }
\ No newline at end of file
@@ -1,10 +1,16 @@
 #include "chatservice.hpp"
+#include "chatcodec.hpp"
+#include "session.hpp"
+#include "metrics.hpp"
 #include "public.hpp"
 #include <muduo/base/Logging.h> // 引用muduo库的日志
 #include <vector>
 using namespace std;
 using namespace muduo;
 
+// 每批下发的离线消息条数, 离线消息很多时登录应答和每个OFFLINE_MSG的大小都有上限
+static const size_t kOfflineBatchSize = 100;
+
 // 获取单例对象的接口函数
 ChatService *ChatService::instance()
 {
@@ -13,21 +19,76 @@ ChatService *ChatService::instance()
     return &service;
 }
 
-// 注册消息以及对应的Handler回调操作
-ChatService::ChatService()
+// 在IO线程中把json解码成Request类型, 再交给业务线程调用业务处理函数Handler, 每种消息实例化一个, 没有虚函数调用
+template <typename Request, void (ChatService::*Handler)(const TcpConnectionPtr &, const Request &, Timestamp)>
+static void dispatchAs(ChatService *service, const TcpConnectionPtr &con, const json &js, const FramePtr &frame, Timestamp time)
+{
+    Request request;
+    if (!request.decodeBase(js) || !request.decode(js, frame))
+    {
+        LOG_ERROR << con->name() << " invalid fields in message, dropped: " << *frame;
+        return;
+    }
+    service->post(con, [service, con, request = std::move(request), time]()
+    {
+        (service->*Handler)(con, request, time);
+    });
+}
+
+// 不含阻塞操作的业务处理函数直接在IO线程中执行, 省去一次交给业务线程的排队
+template <typename Request, void (ChatService::*Handler)(const TcpConnectionPtr &, const Request &, Timestamp)>
+static void dispatchInLoop(ChatService *service, const TcpConnectionPtr &con, const json &js, const FramePtr &frame, Timestamp time)
 {
+    Request request;
+    if (!request.decodeBase(js) || !request.decode(js, frame))
+    {
+        LOG_ERROR << con->name() << " invalid fields in message, dropped: " << *frame;
+        return;
+    }
+    (service->*Handler)(con, request, time);
+}
+
+// 协程形式的业务处理函数直接在IO线程中开始执行, 阻塞操作由协程自己交给业务线程
+template <typename Request, Task (ChatService::*Handler)(TcpConnectionPtr, Request, Timestamp)>
+static void dispatchCoroutine(ChatService *service, const TcpConnectionPtr &con, const json &js, const FramePtr &frame, Timestamp time)
+{
+    Request request;
+    if (!request.decodeBase(js) || !request.decode(js, frame))
+    {
+        LOG_ERROR << con->name() << " invalid fields in message, dropped: " << *frame;
+        return;
+    }
+    (service->*Handler)(con, std::move(request), time);
+}
+
+// 在编译期生成消息id到分发函数的映射表
+static constexpr MsgDispatchTable makeDispatchTable()
+{
+    MsgDispatchTable table{};
+
     // 用户基本业务管理相关事件处理回调注册
-    _msgHandlerMap.insert({LOGIN_MSG, std::bind(&ChatService::login, this, _1, _2, _3)});
-    _msgHandlerMap.insert({LOGINOUT_MSG, std::bind(&ChatService::loginout, this, _1, _2, _3)});
-    _msgHandlerMap.insert({REG_MSG, std::bind(&ChatService::reg, this, _1, _2, _3)});
-    _msgHandlerMap.insert({ONE_CHAT_MSG, std::bind(&ChatService::oneChat, this, _1, _2, _3)});
-    _msgHandlerMap.insert({ADD_FRIEND_MSG, std::bind(&ChatService::addFriend, this, _1, _2, _3)});
+    table[LOGIN_MSG] = &dispatchCoroutine<LoginRequest, &ChatService::login>;
+    table[LOGINOUT_MSG] = &dispatchAs<LoginoutRequest, &ChatService::loginout>;
+    table[REG_MSG] = &dispatchAs<RegRequest, &ChatService::reg>;
+    table[ONE_CHAT_MSG] = &dispatchInLoop<OneChatRequest, &ChatService::oneChat>;
+    table[ADD_FRIEND_MSG] = &dispatchAs<AddFriendRequest, &ChatService::addFriend>;
 
     // 群组业务管理相关事件处理回调注册
-    _msgHandlerMap.insert({CREATE_GROUP_MSG, std::bind(&ChatService::createGroup, this, _1, _2, _3)});
-    _msgHandlerMap.insert({ADD_GROUP_MSG, std::bind(&ChatService::addGroup, this, _1, _2, _3)});
-    _msgHandlerMap.insert({GROUP_CHAT_MSG, std::bind(&ChatService::groupChat, this, _1, _2, _3)});
+    table[CREATE_GROUP_MSG] = &dispatchAs<CreateGroupRequest, &ChatService::createGroup>;
+    table[ADD_GROUP_MSG] = &dispatchAs<AddGroupRequest, &ChatService::addGroup>;
+    table[GROUP_CHAT_MSG] = &dispatchCoroutine<GroupChatRequest, &ChatService::groupChat>;
+
+    // 离线消息分批下发的确认
+    table[OFFLINE_MSG_ACK] = &dispatchAs<OfflineAckRequest, &ChatService::offlineAck>;
 
+    return table;
+}
+
+static constexpr MsgDispatchTable kDispatchTable = makeDispatchTable();
+
+// 连接redis服务器并设置上报消息的回调
+ChatService::ChatService()
+{
     // 连接redis服务器
     if (_redis.connect())
     {
@@ -36,6 +97,88 @@ ChatService::ChatService()
     }
 }
 
+// 启动业务线程池
+void ChatService::startWorkers(int numThreads)
+{
+    _workers.start(numThreads);
+    _fanout.start(numThreads);
+}
+
+// 启动离线消息的批量写入线程
+void ChatService::startOfflineWriter(int flushMs, size_t batchRows, size_t maxQueued)
+{
+    _offlineWriter.start(flushMs, batchRows, maxQueued);
+}
+
+// 在连接con对应的业务线程中执行task
+// 登录后按用户id分片, 与该用户的redis订阅消息在同一个线程中; 登录前按连接分片, 同一个连接的请求保持顺序
+void ChatService::post(const TcpConnectionPtr &con, WorkerPool::Task task)
+{
+    _workers.submit(shardKey(con), std::move(task));
+}
+
+// 连接con对应的业务线程分片
+size_t ChatService::shardKey(const TcpConnectionPtr &con)
+{
+    SessionPtr session = getSession(con);
+    int userid = session ? session->userid.load() : -1;
+    return userid != -1 ? static_cast<size_t>(userid) : hash<TcpConnection *>()(con.get());
+}
+
+// 登记用户userid在本服务器上的连接
+void ChatService::registerUser(int userid, const TcpConnectionPtr &con)
+{
+    if (SessionRouter::instance()->enabled())
+    {
+        SessionRouter::instance()->registerSession(userid, con);
+    }
+    else
+    {
+        _userConns.insert(userid, con);
+    }
+}
+
+// 注销用户userid的连接
+void ChatService::unregisterUser(int userid, const TcpConnectionPtr &con)
+{
+    if (SessionRouter::instance()->enabled())
+    {
+        SessionRouter::instance()->unregisterSession(userid, con);
+    }
+    else if (con)
+    {
+        _userConns.eraseIf(userid, con);
+    }
+    else
+    {
+        _userConns.erase(userid);
+    }
+}
+
+// 向一组用户中在本服务器上的用户投递消息
+void ChatService::deliverLocal(const vector<int> &userids, const ChatPayloadPtr &payload, SessionRouter::MissingCallback missing)
+{
+    if (SessionRouter::instance()->enabled())
+    {
+        // 在各用户的归属IO线程中查找连接并发送, 不再回到调用者的线程
+        SessionRouter::instance()->deliver(userids, [this, payload](int userid, const TcpConnectionPtr &con)
+        {
+            return frameOrSpill(userid, con, payload);
+        }, std::move(missing));
+        return;
+    }
+
+    // 只从用户连接表中取出在本服务器上的连接, 发送消息在查找之外进行
+    vector<pair<int, TcpConnectionPtr>> found;
+    vector<int> notFound;
+    _userConns.findMany(userids, found, notFound);
+    for (auto &user : found)
+    {
+        sendOrSpill(user.first, user.second, payload);
+    }
+    missing(notFound);
+}
+
 // 服务器异常中断,业务重置方法
 void ChatService::reset()
 {
@@ -43,75 +186,110 @@ void ChatService::reset()
     _userModel.resetState();
 }
 
-// 获取某消息id对应的Handler处理器
-MsgHandler ChatService::getHandler(int msgId)
+// 按消息id分发消息, 一次数组下标访问即可找到处理函数
+void ChatService::dispatch(int msgId, const TcpConnectionPtr &con, const json &js, const FramePtr &frame, Timestamp time)
 {
-    // 记录错误日志, msgId没有对应的事件处理回调
-    auto it = _msgHandlerMap.find(msgId);
-    if (it == _msgHandlerMap.end())
-    {
-        // 使用lambda表达式 [=]值捕获 返回一个默认的处理器, 空操作
-        return [=](const TcpConnectionPtr &con, json &js, Timestamp)
-        {
-            LOG_ERROR << "msgId:" << msgId << " can not find handler!";
-        };
-    }
-    else
+    MsgDispatcher dispatcher = (msgId > 0 && msgId < MSG_TYPE_END) ? kDispatchTable[msgId] : nullptr;
+    if (dispatcher == nullptr)
     {
-        // 找到了该消息id的Handler处理器
-        return _msgHandlerMap[msgId];
+        // 记录错误日志, msgId没有对应的事件处理回调
+        LOG_ERROR << "msgId:" << msgId << " can not find handler!";
+        return;
     }
+    dispatcher(this, con, js, frame, time);
 }
 
 // 处理登录业务  id password
-void ChatService::login(const TcpConnectionPtr &con, json &js, Timestamp time)
+Task ChatService::login(TcpConnectionPtr con, LoginRequest request, Timestamp time)
 {
-    int id = js["id"].get<int>(); // 获取接收到客户端发来的用户id数据
-    string pwd = js["password"];  // 获取接收到客户端发来的登录密码数据
+    int id = request.id;               // 获取接收到客户端发来的用户id数据
+    const string &pwd = request.password; // 获取接收到客户端发来的登录密码数据
+
+    // 传入用户id,查询并返回该id对应的数据
+    User user = co_await blocking(con, [this, id]() { return _userModel.queryPrimary(id); }); // 校验密码和在线状态, 读主库
+
+    // 协程在IO线程中恢复, 与连接断开的回调在同一个线程中串行执行:
+    // 查询期间连接已断开时, 断开的回调看到的还是未登录状态, 不会做任何清理, 这里也不能再登记连接和更新状态
+    // 连接仍然有效时, 下面同步地记录userid, 之后再断开时清理任务一定能看到它, 并排在本次登录提交的任务之后执行
+    if (!con->connected())
+    {
+        co_return;
+    }
 
-    User user = _userModel.query(id);               // 传入用户id,查询并返回该id对应的数据
     if (user.getId() == id && user.getPwd() == pwd) // 该用户存在,且密码输入正确
     {
         if (user.getState() == "online") // 检测到该用户已经登录,应不允许重复登录
         {
             json response;                                                // 创建json对象,存储将要发送的数据
             response["msgId"] = LOGIN_MSG_ACK;                            // 设置事件id为登录响应消息
+            request.echoReqId(response);                                  // 回填客户端的请求id
             response["errno"] = 2;                                        // 设错误号为2
             response["errmsg"] = "this account is using, input another!"; // 给出错误提示信息
-            con->send(response.dump());                                   // response.dump()将JSON对象转换为字符串格式,当前连接对象con调用send函数将这些数据发送回给客户端
+            ChatCodec::send(con, response.dump()); // response.dump()将JSON对象转换为字符串格式,由编解码器加上长度头后发送回给客户端
         }
         else // 登录成功
         {
-            // 添加{}表示一个作用域,在{}内加锁,保证线程互斥,出了{}后解锁
+            // 客户端在登录消息中携带 "binary": true, 表示支持二进制格式的聊天消息
+            bool binary = request.binary;
+            SessionPtr session = getSession(con);
+            if (session)
             {
-                lock_guard<mutex> lock(_connMutex); // lock_guard类的构造函数是加锁,析构函数是解锁,利用智能指针实现自动释放锁
-                _userConnMap.insert({id, con});     // 记录用户连接信息
+                session->binaryProto = binary;
+                session->userid = id;
             }
 
-            // 用户id登录成功后, 向redis消息队列订阅通道channel(id)
-            _redis.subscribe(id);
+            registerUser(id, con); // 记录用户连接信息
+
+            user.setState("online"); // 更新该用户状态信息state: offline => online
 
-            user.setState("online");      // 更新该用户状态信息state: offline => online
-            _userModel.updateState(user); // 调用UserModel类的成员方法update,更新数据库user表中该用户的状态信息
+            // 好友列表和群组列表是与其它操作互不依赖的只读查询, 在扇出线程池中用各自的数据库连接同时执行, 登录耗时接近其中最慢的一项
+            // 订阅、状态更新和离线消息必须在该用户自己的业务线程中按顺序执行:
+            // - 与断线清理(置为offline)在同一个线程中, 清理一定排在登录之后, 不会把已断开的用户留在online状态
+            // - 先订阅再置为online, 其它服务器看到online时消息一定能通过redis送达
+            // - 置为online之后再读取离线消息, 读取之后其它服务器不会再把消息转存为离线消息
+            auto [offline, userVec, groupuserVec] = co_await parallel(con,
+                [this, id, user, session]()
+                {
+                    // 用户id登录成功后, 向redis消息队列订阅通道channel(id)
+                    _redis.subscribe(id);
+                    if (!_userModel.updateState(user)) // 更新数据库user表中该用户的状态信息
+                    {
+                        LOG_ERROR << "update state of user " << id << " failed";
+                    }
+
+                    // 查询该用户的第一批离线消息, 客户端确认收到后才删除, 再发送下一批
+                    _offlineWriter.sync(); // 还在批量写入队列中的离线消息先写入数据库
+                    OfflineBatch batch = loadOfflineBatch(id, 0);
+                    if (session)
+                    {
+                        session->offlineSentId = batch.lastId; // 这一批随登录应答发出, 等待客户端确认
+                    }
+                    return batch;
+                },
+                [this, id]() { return _friendModel.query(id); },      // 查询该用户的好友消息
+                [this, id]() { return _groupModel.queryGroups(id); }); // 查询用户的群组信息
+
+            // 等待期间连接已断开, 清理任务已经提交到该用户的业务线程, 会撤销本次登录, 不再发送应答
+            if (!con->connected())
+            {
+                co_return;
+            }
 
             json response;                     // 创建json对象,存储将要发送的数据
             response["msgId"] = LOGIN_MSG_ACK; // 设置事件id为登录响应消息
+            request.echoReqId(response);       // 回填客户端的请求id
             response["errno"] = 0;             // 错误号为0则表示响应成功
             response["id"] = user.getId();     // 获取用户id
             response["name"] = user.getName(); // 获取用户名
+            response["binary"] = binary;       // 告知客户端协商结果, 之后的聊天消息按该协议收发
 
-            // 查询该用户是否有离线消息
-            vector<string> msgVec = _offlineMsgModel.query(id);
-            if (!msgVec.empty())
+            if (!offline.msgs.empty())
             {
-                response["offlinemsg"] = msgVec; // 获取离线消息
-
-                // 读取该用户的离线消息后,删除该用户的所有离线消息
-                _offlineMsgModel.remove(id);
+                response["offlinemsg"] = std::move(offline.msgs); // 获取第一批离线消息
+                response["offlineLastId"] = offline.lastId;       // 客户端用它确认这一批
+                response["offlineMore"] = offline.more;
             }
 
-            // 查询该用户的好友消息
-            vector<User> userVec = _friendModel.query(id);
             if (!userVec.empty())
             {
                 vector<string> vec;
@@ -128,8 +306,6 @@ void ChatService::login(const TcpConnectionPtr &con, json &js, Timestamp time)
                 response["friends"] = vec; // 获取所有好友信息
             }
 
-            // 查询用户的群组信息
-            vector<Group> groupuserVec = _groupModel.queryGroups(id);
             if (!groupuserVec.empty())
             {
                 // group:[{groupid:[xxx, xxx, xxx, xxx]}]
@@ -157,32 +333,34 @@ void ChatService::login(const TcpConnectionPtr &con, json &js, Timestamp time)
                 response["groups"] = groupV;
             }
 
-            con->send(response.dump()); // response.dump()将JSON对象转换为字符串格式,当前连接对象con调用send函数将这些数据发送回给客户端
+            ChatCodec::send(con, response.dump()); // response.dump()将JSON对象转换为字符串格式,由编解码器加上长度头后发送回给客户端
         }
     }
     else if (user.getId() == id && user.getPwd() != pwd) // 该用户存在,但密码输入错误,登录失败
     {
         json response;                          // 创建json对象,存储将要发送的数据
         response["msgId"] = LOGIN_MSG_ACK;      // 设置事件id为登录响应消息
+        request.echoReqId(response);            // 回填客户端的请求id
         response["errno"] = 3;                  // 设错误号为 3
         response["errmsg"] = "Wrong Password!"; // 给出错误提示信息
-        con->send(response.dump());             // response.dump()将JSON对象转换为字符串格式,当前连接对象con调用send函数将这些数据发送回给客户端
+        ChatCodec::send(con, response.dump()); // response.dump()将JSON对象转换为字符串格式,由编解码器加上长度头后发送回给客户端
     }
     else // 该用户不存在(对应 user.getId()== -1 的情况), 登录失败
     {
         json response;                                   // 创建json对象,存储将要发送的数据
         response["msgId"] = LOGIN_MSG_ACK;               // 设置事件id为登录响应消息
+        request.echoReqId(response);                     // 回填客户端的请求id
         response["errno"] = 1;                           // 设错误号为 1
         response["errmsg"] = "this account is invalid!"; // 给出错误提示信息
-        con->send(response.dump());                      // response.dump()将JSON对象转换为字符串格式,当前连接对象con调用send函数将这些数据发送回给客户端
+        ChatCodec::send(con, response.dump()); // response.dump()将JSON对象转换为字符串格式,由编解码器加上长度头后发送回给客户端
     }
 }
 
 // 处理注册业务 name password
-void ChatService::reg(const TcpConnectionPtr &con, json &js, Timestamp time)
+void ChatService::reg(const TcpConnectionPtr &con, const RegRequest &request, Timestamp time)
 {
-    string name = js["name"];    // 获取客户端发来的名字
-    string pwd = js["password"]; // 获取客户端发来的密码
+    const string &name = request.name;    // 获取客户端发来的名字
+    const string &pwd = request.password; // 获取客户端发来的密码
 
     User user;                            // 创建新用户对象user
     user.setName(name);                   // 设置新用户user的名字
@@ -192,32 +370,34 @@ void ChatService::reg(const TcpConnectionPtr &con, json &js, Timestamp time)
     {
         json response;                   // 创建json对象,存储将要发送的数据
         response["msgId"] = REG_MSG_ACK; // 设置事件id为注册响应消息
+        request.echoReqId(response);     // 回填客户端的请求id
         response["errno"] = 0;           // 错误号为0则表示响应成功
         response["id"] = user.getId();   // 获取用户id
-        con->send(response.dump());      // response.dump()将JSON对象转换为字符串格式,当前连接对象con调用send函数将这些数据发送回给客户端
+        ChatCodec::send(con, response.dump()); // response.dump()将JSON对象转换为字符串格式,由编解码器加上长度头后发送回给客户端
     }
     else // 注册失败
     {
         json response;                   // 创建json对象,存储将要发送的数据
         response["msgId"] = REG_MSG_ACK; // 设置事件id为注册响应消息
+        request.echoReqId(response);     // 回填客户端的请求id
         response["errno"] = 1;           // 错误号为1则表示响应失败,后面不需要再获取用户id了
-        con->send(response.dump());      // response.dump()将JSON对象转换为字符串格式,当前连接对象con调用send函数将这些数据发送回给客户端
+        ChatCodec::send(con, response.dump()); // response.dump()将JSON对象转换为字符串格式,由编解码器加上长度头后发送回给客户端
     }
 }
 
 // 处理注销业务
-void ChatService::loginout(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::loginout(const TcpConnectionPtr &conn, const LoginoutRequest &request, Timestamp time)
 {
-    int userid = js["id"].get<int>();
+    int userid = request.id;
+
+    // 从用户连接表中删除当前用户userid的连接信息
+    unregisterUser(userid, nullptr);
 
-    // 线程安全的作用域{}
+    // 连接回到未登录状态, 之后断线时不再重复清理
+    SessionPtr session = getSession(conn);
+    if (session)
     {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(userid); // 在用户连接表中查找是否有当前用户userid的连接
-        if (it != _userConnMap.end())
-        {
-            _userConnMap.erase(it); // 从_userConnMap中删除当前用户userid的连接信息
-        }
+        session->userid = -1;
     }
 
     // 用户注销, 相当于就是下线, 在redis中取消订阅通道
@@ -231,61 +411,91 @@ void ChatService::loginout(const TcpConnectionPtr &conn, json &js, Timestamp tim
 // 处理客户端异常退出
 void ChatService::clientCloseException(const TcpConnectionPtr &con)
 {
-    User user;
-
-    // 线程安全的作用域{}
+    // 连接断开在IO线程中上报, 数据库操作交给该用户的业务线程, 排在该用户之前提交的请求之后执行
+    post(con, [this, con]()
     {
-        lock_guard<mutex> lock(_connMutex); // 加互斥锁
-        for (auto it = _userConnMap.begin(); it != _userConnMap.end(); it++)
+        // 登录时把用户id记录在连接的会话上, 断线时直接取出, 不需要遍历用户连接表
+        SessionPtr session = getSession(con);
+        int userid = session ? session->userid.exchange(-1) : -1;
+        if (userid == -1) // 没有登录或已经注销
         {
-            if (it->second == con) // 找到了这个异常退出的连接
-            {
-                user.setId(it->first); // 获取这个异常退出用户的id
-
-                // 从_userConnMap中删除用户的连接信息
-                _userConnMap.erase(it);
-                break;
-            }
+            return;
         }
-    }
 
-    // 用户注销，相当于就是下线，在redis中取消订阅通道
-    _redis.unsubscribe(user.getId());
+        // 从用户连接表中删除这个异常退出的连接
+        unregisterUser(userid, con);
 
-    // 该用户存在,则更新用户的状态信息
-    if (user.getId() != -1)
-    {
-        user.setState("offline");     // 设置该用户的状态为"offline"
-        _userModel.updateState(user); // 更新数据库中该用户的状态信息
-    }
+        // 用户注销，相当于就是下线，在redis中取消订阅通道
+        _redis.unsubscribe(userid);
+
+        // 更新用户的状态信息
+        User user(userid, "", "", "offline"); // 设置该用户的状态为"offline"
+        _userModel.updateState(user);         // 更新数据库中该用户的状态信息
+    });
 }
 
 // 一对一聊天业务
-void ChatService::oneChat(const TcpConnectionPtr &con, json &js, Timestamp time)
+void ChatService::oneChat(const TcpConnectionPtr &con, const OneChatRequest &request, Timestamp time)
 {
-    int toid = js["toid"].get<int>(); // 获取消息接收者的id
+    // 服务器不修改消息内容, 直接转发客户端发来的原始帧, 不再重新序列化
+    ChatPayloadPtr payload = make_shared<const ChatPayload>(request.frame);
+    deliverOneChat(con, request.toid, payload);
+}
 
+// 处理二进制格式的聊天消息(一对一聊天/群聊)
+void ChatService::binaryChat(const TcpConnectionPtr &con, const ChatMessage &msg, const FramePtr &frame, Timestamp time)
+{
+    ChatPayloadPtr payload = make_shared<const ChatPayload>(msg, frame); // 二进制接收方直接转发原始帧
+    if (msg.msgId == ONE_CHAT_MSG)
     {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(toid); // 在用户连接表中找toid用户的连接
-        if (it != _userConnMap.end()) // 在本服务器中找到了该toid用户连接
-        {
-            // 该toid用户在线, 服务器主动推送消息给接收者
-            it->second->send(js.dump());
-            return;
-        }
+        deliverOneChat(con, msg.toid, payload);
+    }
+    else if (msg.msgId == GROUP_CHAT_MSG)
+    {
+        deliverGroupChat(con, msg.fromid, msg.groupid, payload);
+    }
+    else
+    {
+        LOG_ERROR << "binary msgId:" << msg.msgId << " is not a chat message!";
     }
+}
+
+// 向用户toid投递一对一聊天消息
+void ChatService::deliverOneChat(const TcpConnectionPtr &con, int toid, const ChatPayloadPtr &payload)
+{
+    // toid用户在本服务器上时, 服务器主动推送消息给接收者, 按接收者协商的协议编码
+    size_t key = shardKey(con);
+    deliverLocal(vector<int>(1, toid), payload, [this, key, payload](vector<int> &remoteIds)
+    {
+        relayOrStore(key, remoteIds, payload);
+    });
+}
 
-    // 在本服务器中没找到用户toid的连接, 则在数据库查询用户toid是否在线
-    User user = _userModel.query(toid);
-    if (user.getState() == "online") // 用户toid在线, 表示用户toid在其它服务器上登录了
+// 在业务线程分片key中处理不在本服务器上的接收者
+void ChatService::relayOrStore(size_t key, vector<int> &remoteIds, const ChatPayloadPtr &payload)
+{
+    if (remoteIds.empty())
     {
-        _redis.publish(toid, js.dump()); // 将该消息发送到redis的toid通道
         return;
     }
 
-    // 用户toid不在线,存储离线消息
-    _offlineMsgModel.insert(toid, js.dump());
+    // 调用者可能在IO线程中, 数据库操作交给业务线程
+    _workers.submit(key, [this, remoteIds = std::move(remoteIds), payload]()
+    {
+        for (int id : remoteIds)
+        {
+            // 在本服务器中没找到用户id的连接, 则在数据库查询用户id是否在线
+            if (_userModel.queryState(id) == "online") // 用户id在线, 表示用户id在其它服务器上登录了
+            {
+                _redis.publish(id, *payload->jsonFrame()); // 将该消息发送到redis的id通道, 跨服务器统一使用json格式
+            }
+            else
+            {
+                // 用户id不在线,存储离线消息
+                _offlineWriter.append(id, *payload->jsonFrame());
+            }
+        }
+    });
 }
 
 /*
@@ -294,24 +504,19 @@ todo: 添加好友、创建群组、加入群组业务对应的成功或失败
 */
 
 // 添加好友业务 msgId id friendid
-void ChatService::addFriend(const TcpConnectionPtr &con, json &js, Timestamp time)
+void ChatService::addFriend(const TcpConnectionPtr &con, const AddFriendRequest &request, Timestamp time)
 {
-    int userid = js["id"].get<int>();         // 当前用户id
-    int friendid = js["friendid"].get<int>(); // 待添加的好友id
-
-    // 存储好友信息
-    _friendModel.insert(userid, friendid);
+    // 存储好友信息 当前用户id 待添加的好友id
+    _friendModel.insert(request.id, request.friendid);
 }
 
 // 创建群组业务 id groupname groupdesc
-void ChatService::createGroup(const TcpConnectionPtr &con, json &js, Timestamp time)
+void ChatService::createGroup(const TcpConnectionPtr &con, const CreateGroupRequest &request, Timestamp time)
 {
-    int userid = js["id"].get<int>(); // 正在创建群组的用户id
-    string name = js["groupname"];    // 群名
-    string desc = js["groupdesc"];    // 群描述
+    int userid = request.id; // 正在创建群组的用户id
 
-    // 存储新创建的群组信息
-    Group group(-1, name, desc);
+    // 存储新创建的群组信息 群名 群描述
+    Group group(-1, request.groupname, request.groupdesc);
     if (_groupModel.createGroup(group)) // 群组创建成功,群组id已自动生成
     {
         // 存储群组创建人信息  将群组创建人用户加入群组,获取群组id,设其角色为creator
@@ -320,57 +525,180 @@ void ChatService::createGroup(const TcpConnectionPtr &con, json &js, Timestamp t
 }
 
 // 加入群组业务 id groupid
-void ChatService::addGroup(const TcpConnectionPtr &con, json &js, Timestamp time)
+void ChatService::addGroup(const TcpConnectionPtr &con, const AddGroupRequest &request, Timestamp time)
 {
-    int userid = js["id"].get<int>();                // 要加入群组的用户的id
-    int groupid = js["groupid"].get<int>();          // 用户要加入的群组的id
-    _groupModel.addGroup(userid, groupid, "normal"); // 将该用户加入群组,设其角色为normal
+    // 将要加入群组的用户request.id加入群组request.groupid,设其角色为normal
+    _groupModel.addGroup(request.id, request.groupid, "normal");
 }
 
 // 群组聊天业务
-void ChatService::groupChat(const TcpConnectionPtr &con, json &js, Timestamp time)
+Task ChatService::groupChat(TcpConnectionPtr con, GroupChatRequest request, Timestamp time)
 {
-    int userid = js["id"].get<int>();                                     // 发送群聊消息的用户id
-    int groupid = js["groupid"].get<int>();                               // 用户发送群聊消息所在的群组id
-    vector<int> useridVec = _groupModel.queryGroupUsers(userid, groupid); // 查询该用户userid所在群组groupid的其他用户的id
+    ChatPayloadPtr payload = make_shared<const ChatPayload>(request.frame); // 直接转发客户端发来的原始帧
+    return deliverGroupChat(con, request.id, request.groupid, payload);
+}
 
-    lock_guard<mutex> lock(_connMutex); // 加互斥锁,保证操作_userConnMap的线程安全
-    for (int id : useridVec)            // 向群组groupid中的其他用户转发用户userid发送的群聊消息
+// 向群组groupid中除userid之外的其他成员投递群聊消息
+Task ChatService::deliverGroupChat(TcpConnectionPtr con, int userid, int groupid, ChatPayloadPtr payload)
+{
+    // 查询该用户userid所在群组groupid的其他用户的id
+    vector<int> useridVec = co_await blocking(con, [this, userid, groupid]()
     {
-        auto it = _userConnMap.find(id);
-        if (it != _userConnMap.end()) // 在本服务器找到了该用户id的连接,即该用户在线
-        {
-            // 转发群消息
-            it->second->send(js.dump());
-        }
-        else
+        return _groupModel.queryGroupUsers(userid, groupid);
+    });
+
+    // 转发群消息, 所有成员共享同一份消息内容, 按接收者协商的协议选择格式
+    size_t key = shardKey(con);
+    deliverLocal(useridVec, payload, [this, key, payload](vector<int> &remoteIds)
+    {
+        relayOrStore(key, remoteIds, payload);
+    });
+}
+
+// 向本服务器上用户userid的连接con发送消息, 连接处于限流状态时转存为离线消息
+void ChatService::sendOrSpill(int userid, const TcpConnectionPtr &con, const ChatPayloadPtr &payload)
+{
+    FramePtr frame = frameOrSpill(userid, con, payload);
+    if (frame)
+    {
+        ChatCodec::send(con, frame);
+    }
+}
+
+// 取出发给连接con的消息帧, 连接处于限流状态时转存为离线消息并返回空
+FramePtr ChatService::frameOrSpill(int userid, const TcpConnectionPtr &con, const ChatPayloadPtr &payload)
+{
+    SessionPtr session = getSession(con);
+    if (session && session->throttled)
+    {
+        // 慢消费者的发送缓冲区已超过预算, 不再继续堆积, 缓冲区发送完后由resumeDelivery补发
+        // 调用者可能在IO线程中, 数据库操作交给接收者的业务线程
+        _workers.submit(userid, [this, userid, con, session, payload]()
         {
-            // 在本服务器中没找到用户id的连接, 则在数据库查询用户id是否在线
-            User user = _userModel.query(id);
-            if (user.getState() == "online") // 用户id在线, 表示用户id在其它服务器上登录了
+            // worker_threads为0时这里就是IO线程, 不能等待写入队列的空位, 队列已满时直接写入数据库
+            if (!_offlineWriter.tryAppend(userid, *payload->jsonFrame()))
             {
-                _redis.publish(id, js.dump()); // 将该消息发送到redis的id通道
+                _offlineMsgModel.insert(userid, *payload->jsonFrame());
             }
-            else
+
+            // 限流已经解除时resumeDelivery可能已经读过离线消息了, 没有一批在等待确认时补发一次,
+            // 否则这条消息要等到下次登录才会下发; 有一批在等待确认时由客户端确认后的下一批带上
+            if (!session->throttled && session->userid == userid && session->offlineSentId == session->offlineAckedId)
             {
-                // 存储离线群消息
-                _offlineMsgModel.insert(id, js.dump());
+                _offlineWriter.sync();
+                sendOfflineBatch(con, *session, userid);
             }
+        });
+        Metrics::instance()->spilledMessages++;
+        return nullptr;
+    }
+
+    return payload->frameFor(con); // 消息无法转换成接收者的格式时已记录日志, 返回空
+}
+
+// 限流中的连接发送缓冲区已清空, 补发限流期间转存的离线消息并恢复正常投递
+void ChatService::resumeDelivery(const TcpConnectionPtr &con)
+{
+    // 在IO线程中上报, 查询和删除离线消息交给该用户的业务线程
+    post(con, [this, con]()
+    {
+        SessionPtr session = getSession(con);
+        if (!session)
+        {
+            return;
+        }
+
+        // 先解除限流再读取转存的消息: 之后的消息直接发送, 不会在读取之后才转存而一直留在数据库中
+        if (session->throttled.exchange(false))
+        {
+            Metrics::instance()->throttledConnections--;
         }
+
+        // 有一批离线消息正在等待确认时不另起一轮, 客户端确认后会接着发送限流期间转存的消息
+        int userid = session->userid;
+        if (userid != -1 && session->offlineSentId == session->offlineAckedId)
+        {
+            _offlineWriter.sync(); // 限流期间转存的消息可能还在批量写入队列中
+            sendOfflineBatch(con, *session, userid); // 与登录时一样分批发送, 客户端确认后删除
+        }
+    });
+}
+
+// 客户端确认收到了一批离线消息
+void ChatService::offlineAck(const TcpConnectionPtr &con, const OfflineAckRequest &request, Timestamp time)
+{
+    // 只能确认当前登录用户自己的离线消息
+    SessionPtr session = getSession(con);
+    int userid = session ? session->userid.load() : -1;
+    if (userid == -1 || request.lastId <= session->offlineAckedId)
+    {
+        return;
+    }
+
+    // 最多确认到已发送的位置, 还没有发给客户端的消息不能删除
+    session->offlineAckedId = min(request.lastId, session->offlineSentId);
+
+    // 按id范围删除已确认的消息, 确认之后才存入的消息id更大, 不会被误删
+    _offlineMsgModel.removeUpTo(userid, session->offlineAckedId);
+
+    // 最后发出的一批已全部确认, 接着发送下一批, 包括这期间新存入的离线消息
+    if (session->offlineAckedId == session->offlineSentId)
+    {
+        _offlineWriter.sync(); // 还在批量写入队列中的离线消息先写入数据库
+        sendOfflineBatch(con, *session, userid);
     }
 }
 
-// 从redis消息队列中获取订阅的消息
-void ChatService::handleRedisSubscribeMessage(int userid, string msg)
+// 读取一批离线消息
+ChatService::OfflineBatch ChatService::loadOfflineBatch(int userid, int64_t afterId)
 {
-    lock_guard<mutex> lock(_connMutex);
-    auto it = _userConnMap.find(userid);
-    if (it != _userConnMap.end()) // 找到用户userid的连接
+    OfflineBatch batch;
+    batch.more = _offlineMsgModel.fetch(userid, afterId, kOfflineBatchSize, [&batch](int64_t id, string_view msg)
+    {
+        batch.msgs.push_back(string(msg)); // 边读边放入json数组, 不经过中间的vector<string>
+        batch.lastId = id;
+    });
+    return batch;
+}
+
+// 发送已确认位置之后的一批离线消息
+void ChatService::sendOfflineBatch(const TcpConnectionPtr &con, Session &session, int userid)
+{
+    OfflineBatch batch = loadOfflineBatch(userid, session.offlineAckedId);
+    if (batch.msgs.empty())
     {
-        it->second->send(msg); // 发送消息给用户userid
         return;
     }
+    session.offlineSentId = batch.lastId; // 等待客户端确认这一批
+
+    json response;
+    response["msgId"] = OFFLINE_MSG;
+    response["msgs"] = std::move(batch.msgs);
+    response["lastId"] = batch.lastId;
+    response["more"] = batch.more;
+    ChatCodec::send(con, response.dump());
+}
 
-    // 若用户userid下线了, 存储离线消息
-    _offlineMsgModel.insert(userid, msg);
+// 从redis消息队列中获取订阅的消息
+void ChatService::handleRedisSubscribeMessage(int userid, string msg)
+{
+    // 在redis订阅线程中上报, 交给接收者的业务线程, 与该用户的登录、离线消息补发保持顺序
+    _workers.submit(userid, [this, userid, msg = std::move(msg)]()
+    {
+        ChatPayloadPtr payload = make_shared<const ChatPayload>(make_shared<const string>(msg));
+        // 找到用户userid的连接时发送消息给用户userid, 二进制协议的接收者需要转换格式
+        deliverLocal(vector<int>(1, userid), payload, [this, userid, payload](vector<int> &missing)
+        {
+            if (missing.empty())
+            {
+                return;
+            }
+
+            // 若用户userid下线了, 存储离线消息, 查找可能在IO线程中完成, 数据库操作交回业务线程
+            _workers.submit(userid, [this, userid, payload]()
+            {
+                _offlineWriter.append(userid, *payload->jsonFrame());
+            });
+        });
+    });
 }
\ No newline at end of file
@@ -0,0 +1,392 @@
+#include "config.hpp"
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <getopt.h>
+#include <algorithm>
+
+// 去掉字符串首尾的空白字符
+static string trim(const string &s)
+{
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == string::npos)
+    {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+// 解析非负整数, 失败返回false
+static bool parseInt(const string &s, long &value)
+{
+    if (s.empty())
+    {
+        return false;
+    }
+    char *end = nullptr;
+    value = strtol(s.c_str(), &end, 10);
+    return *end == '\0' && value >= 0;
+}
+
+// 解析CPU列表, 支持 "1-7"、"1,3,5" 以及二者的组合, 空字符串表示不绑定
+static bool parseCpuList(const string &s, vector<int> &cpus)
+{
+    cpus.clear();
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ','))
+    {
+        item = trim(item);
+        if (item.empty())
+        {
+            continue;
+        }
+
+        long first = 0, last = 0;
+        size_t dash = item.find('-');
+        if (dash == string::npos)
+        {
+            if (!parseInt(item, first))
+            {
+                return false;
+            }
+            last = first;
+        }
+        else if (!parseInt(trim(item.substr(0, dash)), first) || !parseInt(trim(item.substr(dash + 1)), last) || last < first)
+        {
+            return false;
+        }
+
+        for (long cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return true;
+}
+
+// 解析地址列表, 如 "10.0.0.2:3306,10.0.0.3", 没有端口时使用defaultPort
+static bool parseHostList(const string &s, uint16_t defaultPort, vector<pair<string, uint16_t>> &hosts)
+{
+    hosts.clear();
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ','))
+    {
+        item = trim(item);
+        if (item.empty())
+        {
+            continue;
+        }
+
+        long port = defaultPort;
+        size_t colon = item.find(':');
+        if (colon != string::npos && (!parseInt(trim(item.substr(colon + 1)), port) || port <= 0 || port > 65535))
+        {
+            return false;
+        }
+        hosts.push_back({trim(item.substr(0, colon)), static_cast<uint16_t>(port)});
+    }
+    return true;
+}
+
+// 设置一个配置项
+bool ServerConfig::set(const string &key, const string &value, string &err)
+{
+    long n = 0;
+    if (key == "ip")
+    {
+        ip = value;
+        return true;
+    }
+    if (key == "db_host" || key == "db_user" || key == "db_password" || key == "db_name")
+    {
+        (key == "db_host" ? dbHost : key == "db_user" ? dbUser : key == "db_password" ? dbPassword : dbName) = value;
+        return true;
+    }
+    if (key == "db_replicas")
+    {
+        if (parseHostList(value, 3306, dbReplicas))
+        {
+            return true;
+        }
+    }
+    if (key == "io_cpus")
+    {
+        if (parseCpuList(value, ioCpus))
+        {
+            return true;
+        }
+    }
+    else if (key == "acceptor_cpu")
+    {
+        if (value == "-1")
+        {
+            acceptorCpus.clear();
+            return true;
+        }
+        if (parseCpuList(value, acceptorCpus))
+        {
+            return true;
+        }
+    }
+    else if (key == "connect_rate" || key == "login_rate" || key == "ip_rate")
+    {
+        char *end = nullptr;
+        double rate = strtod(value.c_str(), &end);
+        if (!value.empty() && *end == '\0' && rate >= 0)
+        {
+            (key == "connect_rate" ? connectRate : key == "login_rate" ? loginRate : ipRate) = rate;
+            return true;
+        }
+    }
+    else if (key == "metrics_interval")
+    {
+        char *end = nullptr;
+        double seconds = strtod(value.c_str(), &end);
+        if (!value.empty() && *end == '\0' && seconds > 0)
+        {
+            metricsInterval = seconds;
+            return true;
+        }
+    }
+    else if (parseInt(value, n))
+    {
+        if (key == "port" && n > 0 && n <= 65535)
+        {
+            port = static_cast<uint16_t>(n);
+            return true;
+        }
+        if (key == "io_threads")
+        {
+            ioThreads = static_cast<int>(n);
+            return true;
+        }
+        if (key == "acceptors" && n > 0)
+        {
+            acceptors = static_cast<int>(n);
+            return true;
+        }
+        if (key == "home_loops" && (n == 0 || n == 1))
+        {
+            homeLoops = n == 1;
+            return true;
+        }
+        if (key == "worker_threads" && n >= 0)
+        {
+            workerThreads = static_cast<int>(n);
+            return true;
+        }
+        if (key == "idle_timeout")
+        {
+            idleTimeout = static_cast<int>(n);
+            return true;
+        }
+        if (key == "db_port" && n > 0 && n <= 65535)
+        {
+            dbPort = static_cast<uint16_t>(n);
+            return true;
+        }
+        if (key == "db_max_replica_lag")
+        {
+            dbMaxReplicaLag = static_cast<int>(n);
+            return true;
+        }
+        if (key == "db_pool_min" && n >= 0)
+        {
+            dbPoolMin = static_cast<int>(n);
+            return true;
+        }
+        if (key == "db_pool_max" && n > 0)
+        {
+            dbPoolMax = static_cast<int>(n);
+            return true;
+        }
+        if (key == "db_idle_timeout")
+        {
+            dbIdleTimeout = static_cast<int>(n);
+            return true;
+        }
+        if (key == "db_wait_timeout_ms")
+        {
+            dbWaitTimeoutMs = static_cast<int>(n);
+            return true;
+        }
+        if (key == "offline_batch_ms")
+        {
+            offlineBatchMs = static_cast<int>(n);
+            return true;
+        }
+        if ((key == "offline_batch_rows" || key == "offline_queue_max") && n > 0)
+        {
+            (key == "offline_batch_rows" ? offlineBatchRows : offlineQueueMax) = static_cast<int>(n);
+            return true;
+        }
+        if (key == "output_budget_kb" && n > 0)
+        {
+            outputBudget = static_cast<size_t>(n) * 1024;
+            return true;
+        }
+    }
+
+    err = "invalid config " + key + " = " + value;
+    return false;
+}
+
+// 读取配置文件
+bool ServerConfig::loadFile(const string &path, string &err)
+{
+    ifstream in(path);
+    if (!in)
+    {
+        err = "can not open config file " + path;
+        return false;
+    }
+
+    string line;
+    int lineno = 0;
+    while (getline(in, line))
+    {
+        ++lineno;
+        line = trim(line);
+        if (line.empty() || line[0] == '#') // 空行和注释
+        {
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == string::npos)
+        {
+            err = path + ":" + to_string(lineno) + ": missing '='";
+            return false;
+        }
+        if (!set(trim(line.substr(0, eq)), trim(line.substr(eq + 1)), err))
+        {
+            err = path + ":" + to_string(lineno) + ": " + err;
+            return false;
+        }
+    }
+    return true;
+}
+
+// 没有短选项的长选项, 取值不与任何字符冲突
+enum
+{
+    kOptDbPoolMin = 256,
+    kOptDbPoolMax,
+};
+
+// 解析命令行, 配置文件中的值会被命令行选项覆盖
+bool ServerConfig::parseArgs(int argc, char **argv, string &err)
+{
+    // 长选项 => 配置文件中的key
+    static const struct option options[] = {
+        {"config", required_argument, nullptr, 'c'},
+        {"threads", required_argument, nullptr, 't'},
+        {"io-cpus", required_argument, nullptr, 'p'},
+        {"acceptors", required_argument, nullptr, 'n'},
+        {"acceptor-cpu", required_argument, nullptr, 'a'},
+        {"output-budget-kb", required_argument, nullptr, 'o'},
+        {"workers", required_argument, nullptr, 'w'},
+        {"home-loops", required_argument, nullptr, 'H'},
+        {"idle-timeout", required_argument, nullptr, 'i'},
+        {"connect-rate", required_argument, nullptr, 'C'},
+        {"login-rate", required_argument, nullptr, 'L'},
+        {"ip-rate", required_argument, nullptr, 'I'},
+        {"metrics-interval", required_argument, nullptr, 'm'},
+        {"db-pool-min", required_argument, nullptr, kOptDbPoolMin},
+        {"db-pool-max", required_argument, nullptr, kOptDbPoolMax},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    // 先找出配置文件并加载, 保证命令行选项的优先级更高
+    vector<pair<string, string>> overrides;
+    int opt = 0;
+    while ((opt = getopt_long(argc, argv, "c:t:p:n:a:o:w:H:i:C:L:I:m:", options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            if (!loadFile(optarg, err))
+            {
+                return false;
+            }
+            break;
+        case 't': overrides.push_back({"io_threads", optarg}); break;
+        case 'p': overrides.push_back({"io_cpus", optarg}); break;
+        case 'n': overrides.push_back({"acceptors", optarg}); break;
+        case 'a': overrides.push_back({"acceptor_cpu", optarg}); break;
+        case 'o': overrides.push_back({"output_budget_kb", optarg}); break;
+        case 'w': overrides.push_back({"worker_threads", optarg}); break;
+        case 'H': overrides.push_back({"home_loops", optarg}); break;
+        case 'i': overrides.push_back({"idle_timeout", optarg}); break;
+        case 'C': overrides.push_back({"connect_rate", optarg}); break;
+        case 'L': overrides.push_back({"login_rate", optarg}); break;
+        case 'I': overrides.push_back({"ip_rate", optarg}); break;
+        case 'm': overrides.push_back({"metrics_interval", optarg}); break;
+        case kOptDbPoolMin: overrides.push_back({"db_pool_min", optarg}); break;
+        case kOptDbPoolMax: overrides.push_back({"db_pool_max", optarg}); break;
+        default:
+            err = "unknown option";
+            return false;
+        }
+    }
+
+    for (auto &kv : overrides)
+    {
+        if (!set(kv.first, kv.second, err))
+        {
+            return false;
+        }
+    }
+
+    // 兼容原来的用法: 位置参数 ip port
+    if (argc - optind >= 2)
+    {
+        if (!set("ip", argv[optind], err) || !set("port", argv[optind + 1], err))
+        {
+            return false;
+        }
+    }
+    else if (argc - optind == 1)
+    {
+        err = "both ip and port are required";
+        return false;
+    }
+
+    // db_pool_min和db_pool_max可能分别来自配置文件和命令行, 全部设置完之后再检查两者的关系
+    if (dbPoolMin > dbPoolMax)
+    {
+        err = "invalid config db_pool_min = " + to_string(dbPoolMin) + " > db_pool_max = " + to_string(dbPoolMax);
+        return false;
+    }
+    return true;
+}
+
+// 命令行用法说明
+string ServerConfig::usage()
+{
+    return "usage: ./ChatServer [ip port] [--config file] [--threads N] [--io-cpus 1-7] [--acceptors N]\n"
+           "                    [--acceptor-cpu 0] [--output-budget-kb N] [--workers N]\n"
+           "                    [--idle-timeout S] [--connect-rate N] [--login-rate N] [--ip-rate N]\n"
+           "                    [--home-loops 0|1] [--metrics-interval S] [--db-pool-min N] [--db-pool-max N]\n"
+           "example: ./ChatServer 127.0.0.1 6000 --threads 8 --io-cpus 2-9 --acceptors 2 --acceptor-cpu 0-1";
+}
+
+// IO线程数量的实际取值
+int ServerConfig::effectiveIoThreads() const
+{
+    if (ioThreads > 0)
+    {
+        return ioThreads;
+    }
+    unsigned int cores = thread::hardware_concurrency();
+    return cores > 0 ? static_cast<int>(cores) : 4;
+}
+
+// 每个acceptor分到的IO线程数量
+int ServerConfig::ioThreadsPerAcceptor() const
+{
+    return max(1, effectiveIoThreads() / acceptors);
+}
@@ -0,0 +1,183 @@
+#include "connectionpool.hpp"
+#include "metrics.hpp"
+#include <muduo/base/Logging.h>
+#include <vector>
+
+// 连接空闲超过该秒数后, 取出前先mysql_ping检查是否仍然可用
+static const double kPingIdleSeconds = 5.0;
+
+// 建立minSize个连接并启动空闲连接回收线程
+void ConnectionPool::init(size_t minSize, size_t maxSize, int idleSeconds, int waitTimeoutMs)
+{
+    _maxSize = max<size_t>(1, maxSize);
+    _minSize = min(minSize, _maxSize);
+    _idleSeconds = idleSeconds;
+    _waitTimeoutMs = waitTimeoutMs;
+
+    for (size_t i = 0; i < _minSize; ++i)
+    {
+        MySQL *conn = createConnection();
+        if (conn == nullptr)
+        {
+            break; // 数据库暂时不可用, 剩下的连接在需要时再建立
+        }
+        lock_guard<mutex> lock(_mutex);
+        ++_total;
+        _idle.push_back(conn);
+    }
+    LOG_INFO << "mysql connection pool " << _endpoint.host << ":" << _endpoint.port << ": " << _total << " connections, min " << _minSize << ", max " << _maxSize;
+
+    if (_idleSeconds > 0)
+    {
+        _scanner = thread(&ConnectionPool::scanIdleConnections, this);
+    }
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _scanCond.notify_one();
+    if (_scanner.joinable())
+    {
+        _scanner.join();
+    }
+    for (MySQL *conn : _idle)
+    {
+        delete conn;
+    }
+}
+
+// 取出一个可用的连接
+shared_ptr<MySQL> ConnectionPool::getConnection()
+{
+    Metrics *metrics = Metrics::instance();
+    auto start = chrono::steady_clock::now();
+
+    MySQL *conn = nullptr;
+    {
+        unique_lock<mutex> lock(_mutex);
+        bool ready = _cond.wait_until(lock, start + chrono::milliseconds(_waitTimeoutMs), [this]()
+        {
+            return !_idle.empty() || _total < _maxSize;
+        });
+        if (!ready)
+        {
+            metrics->dbWaitTimeouts++;
+            LOG_ERROR << "mysql connection pool " << _endpoint.host << ":" << _endpoint.port << ": wait timeout, " << _total << " connections in use";
+            return nullptr;
+        }
+
+        if (!_idle.empty())
+        {
+            conn = _idle.back();
+            _idle.pop_back();
+        }
+        else
+        {
+            ++_total; // 先占住名额, 在锁外建立连接
+        }
+    }
+
+    // 空闲较久的连接可能已经被服务器关闭(wait_timeout)或网络已断开, 换成新连接
+    if (conn != nullptr && conn->idleSeconds() >= kPingIdleSeconds && !conn->ping())
+    {
+        metrics->dbClosedConnections++;
+        delete conn;
+        conn = nullptr;
+    }
+    if (conn == nullptr)
+    {
+        conn = createConnection();
+        if (conn == nullptr)
+        {
+            {
+                lock_guard<mutex> lock(_mutex);
+                --_total;
+            }
+            _cond.notify_one();
+            return nullptr;
+        }
+    }
+
+    int64_t waitMicros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    metrics->dbAcquires++;
+    metrics->dbWaitMicros += waitMicros;
+    Metrics::updateMax(metrics->dbMaxWaitMicros, waitMicros);
+
+    return shared_ptr<MySQL>(conn, [this](MySQL *c) { release(c); });
+}
+
+// 新建一个连接
+MySQL *ConnectionPool::createConnection()
+{
+    MySQL *conn = new MySQL(_endpoint);
+    if (!conn->connect())
+    {
+        delete conn;
+        return nullptr;
+    }
+    Metrics::instance()->dbCreatedConnections++;
+    conn->refreshAliveTime();
+    return conn;
+}
+
+// 归还连接
+void ConnectionPool::release(MySQL *conn)
+{
+    if (conn->broken())
+    {
+        closeConnection(conn);
+        return;
+    }
+
+    conn->refreshAliveTime();
+    {
+        lock_guard<mutex> lock(_mutex);
+        _idle.push_back(conn);
+    }
+    _cond.notify_one();
+}
+
+// 关闭一个连接
+void ConnectionPool::closeConnection(MySQL *conn)
+{
+    delete conn; // mysql_close会与服务器通信, 不在锁内执行
+    Metrics::instance()->dbClosedConnections++;
+    {
+        lock_guard<mutex> lock(_mutex);
+        --_total;
+    }
+    _cond.notify_one();
+}
+
+// 周期性地关闭空闲太久的连接
+void ConnectionPool::scanIdleConnections()
+{
+    unique_lock<mutex> lock(_mutex);
+    while (!_stopping)
+    {
+        _scanCond.wait_for(lock, chrono::seconds(1), [this]() { return _stopping; });
+
+        // 头部是空闲最久的连接, 从头部开始回收, 至少保留minSize个
+        vector<MySQL *> expired;
+        while (!_idle.empty() && _total - expired.size() > _minSize && _idle.front()->idleSeconds() >= _idleSeconds)
+        {
+            expired.push_back(_idle.front());
+            _idle.pop_front();
+        }
+        if (expired.empty())
+        {
+            continue;
+        }
+
+        lock.unlock();
+        for (MySQL *conn : expired)
+        {
+            closeConnection(conn);
+        }
+        lock.lock();
+    }
+}
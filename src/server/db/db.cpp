@@ -1,14 +1,10 @@
 #include "db.h"
+#include "statement.hpp"
 #include <muduo/base/Logging.h>
 
-// 数据库配置信息
-static string server = "127.0.0.1";
-static string user = "root";
-static string password = "123456";
-static string dbname = "chat";
-
 // 初始化数据库连接
-MySQL::MySQL()
+MySQL::MySQL(const DbEndpoint &endpoint)
+    : _endpoint(endpoint)
 {
     _conn = mysql_init(nullptr);
 }
@@ -16,6 +12,7 @@ MySQL::MySQL()
 // 释放数据库连接资源
 MySQL::~MySQL()
 {
+    _stmts.clear(); // 预处理语句要在连接关闭之前关闭
     if (_conn != nullptr)
         mysql_close(_conn);
 }
@@ -23,17 +20,21 @@ MySQL::~MySQL()
 // 连接数据库
 bool MySQL::connect()
 {
-    MYSQL *p = mysql_real_connect(_conn, server.c_str(), user.c_str(),
-                                  password.c_str(), dbname.c_str(), 3306, nullptr, 0);
+    // 数据库(如某个从库)不可达时不要长时间阻塞业务线程
+    unsigned int timeout = 3;
+    mysql_options(_conn, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+
+    MYSQL *p = mysql_real_connect(_conn, _endpoint.host.c_str(), _endpoint.user.c_str(),
+                                  _endpoint.password.c_str(), _endpoint.dbname.c_str(), _endpoint.port, nullptr, 0);
     if (p != nullptr)
     {
         // C/C++默认的编码字符是ASCII,需设为gbk,中文显示才不会乱码
         mysql_query(_conn, "set names gbk");
-        LOG_INFO << "connect mysql success!";
+        LOG_INFO << "connect mysql " << _endpoint.host << ":" << _endpoint.port << " success!";
     }
     else
     {
-        LOG_INFO << "connect mysql fail!";
+        LOG_INFO << "connect mysql " << _endpoint.host << ":" << _endpoint.port << " fail!";
     }
     return p;
 }
@@ -45,6 +46,7 @@ bool MySQL::update(string sql)
     {
         LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
                  << sql << "更新失败!";
+        checkError();
         return false;
     }
     return true;
@@ -57,13 +59,52 @@ MYSQL_RES* MySQL::query(string sql)
     {
         LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
                  << sql << "查询失败!";
+        checkError();
         return nullptr;
     }
     return mysql_use_result(_conn);
 }
 
+// 查询操作, 返回逐行读取的结果集
+ResultSet MySQL::cursor(const string &sql)
+{
+    return ResultSet(query(sql));
+}
+
 // 获取连接  用于在usermodel.cpp的insert函数里获取插入成功的用户数据生成的主键id
 MYSQL* MySQL::getConnection()
 {
     return _conn;
+}
+
+// 转义字符串中的特殊字符
+string MySQL::escape(const string &value)
+{
+    string escaped(value.size() * 2 + 1, '\0');
+    unsigned long length = mysql_real_escape_string(_conn, &escaped[0], value.data(), value.size());
+    escaped.resize(length);
+    return escaped;
+}
+
+// 检查连接是否仍然可用
+bool MySQL::ping()
+{
+    if (mysql_ping(_conn) != 0)
+    {
+        LOG_INFO << "mysql ping fail: " << mysql_error(_conn);
+        _broken = true;
+        return false;
+    }
+    return true;
+}
+
+// 记录失败的原因
+void MySQL::checkError()
+{
+    unsigned int err = mysql_errno(_conn);
+    LOG_INFO << "mysql error " << err << ": " << mysql_error(_conn);
+    if (err >= 2000 && err < 3000) // CR_SERVER_GONE_ERROR、CR_SERVER_LOST等客户端错误
+    {
+        _broken = true;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "dbrouter.hpp"
+#include "metrics.hpp"
+#include <muduo/base/Logging.h>
+#include <cstring>
+
+// 获取单例对象的接口函数
+DbRouter *DbRouter::instance()
+{
+    static DbRouter router;
+    return &router;
+}
+
+// 为主库和每个从库创建连接池并启动复制延迟检测线程
+void DbRouter::init(const DbEndpoint &primary, const vector<DbEndpoint> &replicas,
+                    size_t poolMin, size_t poolMax, int idleSeconds, int waitTimeoutMs, int maxLagSeconds)
+{
+    _maxLagSeconds = maxLagSeconds;
+
+    _primary.reset(new ConnectionPool(primary));
+    _primary->init(poolMin, poolMax, idleSeconds, waitTimeoutMs);
+
+    for (const DbEndpoint &endpoint : replicas)
+    {
+        unique_ptr<Replica> replica(new Replica);
+        replica->pool.reset(new ConnectionPool(endpoint));
+        replica->pool->init(poolMin, poolMax, idleSeconds, waitTimeoutMs);
+        replica->healthy = checkReplica(*replica); // 启动时先检测一次, 不健康的从库不分配读请求
+        _replicas.push_back(std::move(replica));
+    }
+
+    if (!_replicas.empty())
+    {
+        _monitor = thread(&DbRouter::monitorReplicas, this);
+    }
+}
+
+DbRouter::~DbRouter()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _cond.notify_one();
+    if (_monitor.joinable())
+    {
+        _monitor.join();
+    }
+}
+
+// 取出一个主库连接
+shared_ptr<MySQL> DbRouter::primary()
+{
+    if (_primary == nullptr) // 没有调用init时使用默认的数据库配置
+    {
+        static ConnectionPool defaultPool{DbEndpoint()};
+        return defaultPool.getConnection();
+    }
+    return _primary->getConnection();
+}
+
+// 轮流从健康的从库取出一个连接
+shared_ptr<MySQL> DbRouter::replica()
+{
+    if (_replicas.empty())
+    {
+        return primary();
+    }
+
+    size_t start = _next++;
+    for (size_t i = 0; i < _replicas.size(); ++i)
+    {
+        Replica &replica = *_replicas[(start + i) % _replicas.size()];
+        if (!replica.healthy)
+        {
+            continue;
+        }
+        shared_ptr<MySQL> conn = replica.pool->getConnection();
+        if (conn != nullptr)
+        {
+            Metrics::instance()->dbReplicaReads++;
+            return conn;
+        }
+    }
+
+    // 所有从库都延迟过大或不可用, 读主库
+    Metrics::instance()->dbReplicaFallbacks++;
+    return primary();
+}
+
+// 检测一个从库的复制延迟
+bool DbRouter::checkReplica(Replica &replica)
+{
+    const DbEndpoint &endpoint = replica.pool->endpoint();
+    if (replica.monitor == nullptr || replica.monitor->broken())
+    {
+        replica.monitor.reset(new MySQL(endpoint));
+        if (!replica.monitor->connect())
+        {
+            replica.monitor.reset();
+            return false;
+        }
+    }
+
+    // MySQL 8.0.22之后是SHOW REPLICA STATUS和Seconds_Behind_Source, 之前的版本是SHOW SLAVE STATUS和Seconds_Behind_Master
+    MYSQL *conn = replica.monitor->getConnection();
+    if (mysql_query(conn, "show replica status") != 0 && mysql_query(conn, "show slave status") != 0)
+    {
+        LOG_ERROR << "replica " << endpoint.host << ":" << endpoint.port << ": " << mysql_error(conn);
+        unsigned int err = mysql_errno(conn);
+        if (err >= 2000 && err < 3000) // 连接已断开, 下次重新连接
+        {
+            replica.monitor.reset();
+        }
+        return false;
+    }
+    MYSQL_RES *res = mysql_store_result(conn);
+    if (res == nullptr)
+    {
+        return false;
+    }
+
+    int lagColumn = -1;
+    MYSQL_FIELD *fields = mysql_fetch_fields(res);
+    for (unsigned int i = 0; i < mysql_num_fields(res); ++i)
+    {
+        if (strcmp(fields[i].name, "Seconds_Behind_Source") == 0 || strcmp(fields[i].name, "Seconds_Behind_Master") == 0)
+        {
+            lagColumn = static_cast<int>(i);
+        }
+    }
+
+    // 没有复制状态(不是从库)或延迟为NULL(复制线程已停止)都视为不可用
+    bool healthy = false;
+    MYSQL_ROW row = mysql_fetch_row(res);
+    if (row != nullptr && lagColumn >= 0 && row[lagColumn] != nullptr)
+    {
+        int lag = atoi(row[lagColumn]);
+        healthy = lag <= _maxLagSeconds;
+        if (!healthy)
+        {
+            LOG_WARN << "replica " << endpoint.host << ":" << endpoint.port << " lags " << lag << "s behind primary";
+        }
+    }
+    mysql_free_result(res);
+    return healthy;
+}
+
+// 每秒检测一次所有从库
+void DbRouter::monitorReplicas()
+{
+    unique_lock<mutex> lock(_mutex);
+    while (!_cond.wait_for(lock, chrono::seconds(1), [this]() { return _stopping; }))
+    {
+        lock.unlock();
+        for (auto &replica : _replicas)
+        {
+            bool healthy = checkReplica(*replica);
+            if (replica->healthy.exchange(healthy) != healthy)
+            {
+                const DbEndpoint &endpoint = replica->pool->endpoint();
+                LOG_INFO << "replica " << endpoint.host << ":" << endpoint.port << (healthy ? " is back in rotation" : " is out of rotation");
+            }
+        }
+        lock.lock();
+    }
+}
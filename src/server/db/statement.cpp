@@ -0,0 +1,261 @@
+#include "statement.hpp"
+#include <muduo/base/Logging.h>
+#include <cstring>
+
+// 字符串列缓冲区的初始大小, 超出时按实际长度扩大
+static const size_t kInitialColumnBuffer = 256;
+
+// 从连接的缓存中取出sql对应的预处理语句, 第一次使用时准备
+Statement::Statement(MySQL &mysql, const char *sql)
+    : _mysql(mysql), _sql(sql)
+{
+    auto it = _mysql._stmts.find(sql);
+    if (it != _mysql._stmts.end())
+    {
+        _prepared = it->second.get();
+        return;
+    }
+
+    unique_ptr<PreparedStatement> prepared(new PreparedStatement);
+    prepared->stmt = mysql_stmt_init(_mysql.getConnection());
+    if (prepared->stmt == nullptr)
+    {
+        LOG_ERROR << "mysql_stmt_init fail: " << sql;
+        return;
+    }
+    if (mysql_stmt_prepare(prepared->stmt, sql, strlen(sql)) != 0)
+    {
+        _prepared = prepared.get();
+        checkError();
+        _prepared = nullptr;
+        return;
+    }
+
+    // 参数绑定的缓冲区
+    size_t paramCount = mysql_stmt_param_count(prepared->stmt);
+    prepared->params.resize(paramCount);
+    prepared->intParams.resize(paramCount);
+    prepared->strParams.resize(paramCount);
+    prepared->paramLengths.resize(paramCount);
+
+    // 结果列绑定的缓冲区, 只有查询语句有结果集
+    MYSQL_RES *meta = mysql_stmt_result_metadata(prepared->stmt);
+    if (meta != nullptr)
+    {
+        unsigned int fieldCount = mysql_num_fields(meta);
+        MYSQL_FIELD *fields = mysql_fetch_fields(meta);
+        prepared->columns.resize(fieldCount);
+        prepared->results.resize(fieldCount);
+        for (unsigned int i = 0; i < fieldCount; ++i)
+        {
+            PreparedStatement::Column &column = prepared->columns[i];
+            switch (fields[i].type)
+            {
+            case MYSQL_TYPE_TINY:
+            case MYSQL_TYPE_SHORT:
+            case MYSQL_TYPE_LONG:
+            case MYSQL_TYPE_INT24:
+            case MYSQL_TYPE_LONGLONG:
+                column.isInt = true;
+                break;
+            default:
+                column.buffer.resize(kInitialColumnBuffer);
+                break;
+            }
+        }
+        mysql_free_result(meta);
+    }
+
+    _prepared = prepared.get();
+    _mysql._stmts[sql] = std::move(prepared);
+}
+
+Statement::~Statement()
+{
+    // 释放没有读完的结果集, 否则该连接上的下一条语句会报 Commands out of sync
+    if (_executed && !_prepared->columns.empty())
+    {
+        mysql_stmt_free_result(_prepared->stmt);
+    }
+}
+
+// 按顺序绑定下一个整数参数
+Statement &Statement::bind(int64_t value)
+{
+    if (_prepared != nullptr && _nextParam < _prepared->params.size())
+    {
+        MYSQL_BIND &param = _prepared->params[_nextParam];
+        memset(&param, 0, sizeof(param));
+        _prepared->intParams[_nextParam] = value;
+        param.buffer_type = MYSQL_TYPE_LONGLONG;
+        param.buffer = &_prepared->intParams[_nextParam];
+    }
+    ++_nextParam;
+    return *this;
+}
+
+// 按顺序绑定下一个字符串参数, 复制到语句自己的缓冲区中, 执行前参数的生命周期可以结束
+Statement &Statement::bind(const string &value)
+{
+    if (_prepared != nullptr && _nextParam < _prepared->params.size())
+    {
+        MYSQL_BIND &param = _prepared->params[_nextParam];
+        memset(&param, 0, sizeof(param));
+        string &buffer = _prepared->strParams[_nextParam];
+        buffer.assign(value); // 复用上次执行时分配的容量
+        _prepared->paramLengths[_nextParam] = buffer.size();
+        param.buffer_type = MYSQL_TYPE_STRING;
+        param.buffer = const_cast<char *>(buffer.data());
+        param.buffer_length = buffer.size();
+        param.length = &_prepared->paramLengths[_nextParam];
+    }
+    ++_nextParam;
+    return *this;
+}
+
+// 执行语句
+bool Statement::execute()
+{
+    if (_prepared == nullptr)
+    {
+        return false;
+    }
+    if (_nextParam != _prepared->params.size())
+    {
+        LOG_ERROR << _sql << ": expect " << _prepared->params.size() << " params, got " << _nextParam;
+        return false;
+    }
+
+    MYSQL_STMT *stmt = _prepared->stmt;
+    if ((!_prepared->params.empty() && mysql_stmt_bind_param(stmt, _prepared->params.data())) || mysql_stmt_execute(stmt) != 0)
+    {
+        checkError();
+        return false;
+    }
+    _executed = true;
+
+    // 绑定结果列, 缓冲区在上次执行时可能因为扩大而移动过, 每次执行都重新绑定
+    for (size_t i = 0; i < _prepared->columns.size(); ++i)
+    {
+        PreparedStatement::Column &column = _prepared->columns[i];
+        MYSQL_BIND &result = _prepared->results[i];
+        memset(&result, 0, sizeof(result));
+        if (column.isInt)
+        {
+            result.buffer_type = MYSQL_TYPE_LONGLONG;
+            result.buffer = &column.intValue;
+        }
+        else
+        {
+            result.buffer_type = MYSQL_TYPE_STRING;
+            result.buffer = column.buffer.data();
+            result.buffer_length = column.buffer.size();
+        }
+        result.length = &column.length;
+        result.is_null = &column.isNull;
+        result.error = &column.error;
+    }
+    if (!_prepared->results.empty() && mysql_stmt_bind_result(stmt, _prepared->results.data()))
+    {
+        checkError();
+        return false;
+    }
+    return true;
+}
+
+// 读取结果集的下一行
+bool Statement::fetch()
+{
+    if (!_executed || _prepared->columns.empty())
+    {
+        return false;
+    }
+
+    MYSQL_STMT *stmt = _prepared->stmt;
+    int rc = mysql_stmt_fetch(stmt);
+    if (rc == MYSQL_NO_DATA)
+    {
+        return false;
+    }
+    if (rc == 1)
+    {
+        checkError();
+        return false;
+    }
+
+    // 有字符串列超出了缓冲区: 按实际长度扩大缓冲区, 单独取回该列
+    if (rc == MYSQL_DATA_TRUNCATED)
+    {
+        for (size_t i = 0; i < _prepared->columns.size(); ++i)
+        {
+            PreparedStatement::Column &column = _prepared->columns[i];
+            if (!column.error || column.isInt)
+            {
+                continue;
+            }
+            column.buffer.resize(column.length);
+            MYSQL_BIND &result = _prepared->results[i];
+            result.buffer = column.buffer.data();
+            result.buffer_length = column.buffer.size();
+            if (mysql_stmt_fetch_column(stmt, &result, static_cast<unsigned int>(i), 0) != 0)
+            {
+                checkError();
+                return false;
+            }
+        }
+        // 下一行使用扩大后的缓冲区
+        if (mysql_stmt_bind_result(stmt, _prepared->results.data()))
+        {
+            checkError();
+            return false;
+        }
+    }
+    return true;
+}
+
+// 当前行第col列的整数值
+int64_t Statement::getInt(int col) const
+{
+    const PreparedStatement::Column &column = _prepared->columns[col];
+    if (column.isNull)
+    {
+        return 0;
+    }
+    if (column.isInt)
+    {
+        return column.intValue;
+    }
+    return strtoll(string(column.buffer.data(), column.length).c_str(), nullptr, 10);
+}
+
+// 当前行第col列的字符串值
+string Statement::getString(int col) const
+{
+    const PreparedStatement::Column &column = _prepared->columns[col];
+    if (column.isNull)
+    {
+        return string();
+    }
+    if (column.isInt)
+    {
+        return to_string(column.intValue);
+    }
+    return string(column.buffer.data(), column.length);
+}
+
+// insert语句生成的自增id
+uint64_t Statement::insertId() const
+{
+    return _prepared != nullptr ? mysql_stmt_insert_id(_prepared->stmt) : 0;
+}
+
+// 检查语句的错误
+void Statement::checkError()
+{
+    unsigned int err = mysql_stmt_errno(_prepared->stmt);
+    LOG_ERROR << _sql << ": mysql error " << err << ": " << mysql_stmt_error(_prepared->stmt);
+    if (err >= 2000 && err < 3000) // 连接已断开, 连接池不再复用该连接
+    {
+        _mysql._broken = true;
+    }
+}
@@ -0,0 +1,106 @@
+#include "deliveryqueue.hpp"
+#include "metrics.hpp"
+#include <unordered_map>
+
+DeliveryQueue::DeliveryQueue(EventLoop *loop)
+    : _loop(loop), _flushQueued(false), _batchStartMicros(0)
+{
+}
+
+// 把发往con的消息帧放入待发送队列
+void DeliveryQueue::enqueue(const TcpConnectionPtr &con, const FramePtr &frame)
+{
+    _pending.push({con, frame});
+    if (!_flushQueued.exchange(true)) // 本批第一条消息, 需要提交一次flush任务
+    {
+        _batchStartMicros.store(Timestamp::now().microSecondsSinceEpoch());
+        // queueInLoop的任务在本轮事件循环处理完所有IO事件之后执行,
+        // 这一轮里后续入队的消息都会被同一次flush发送出去
+        _loop->queueInLoop(std::bind(&DeliveryQueue::flush, this));
+    }
+}
+
+// 在loop线程中执行, 发送所有待发送的消息帧
+void DeliveryQueue::flush()
+{
+    // 先清除标志再取消息, 之后入队的消息要么在本次被取出, 要么会提交新的flush
+    Timestamp batchStart(_batchStartMicros.load());
+    _flushQueued.store(false);
+
+    vector<pair<TcpConnectionPtr, FramePtr>> pending;
+    takePending(pending);
+    if (pending.empty())
+    {
+        return;
+    }
+
+    sendFrames(pending);
+
+    Metrics *metrics = Metrics::instance();
+    int64_t flushMicros = Timestamp::now().microSecondsSinceEpoch() - batchStart.microSecondsSinceEpoch();
+    metrics->deliveryFlushes++;
+    metrics->deliveryFlushMicros += flushMicros;
+    Metrics::updateMax(metrics->deliveryMaxFlushMicros, flushMicros);
+}
+
+// 在loop线程中立即发送frames, 排在此前入队的消息之后
+void DeliveryQueue::sendInLoop(const vector<pair<TcpConnectionPtr, FramePtr>> &frames)
+{
+    // 已经提交的flush任务之后执行时取不到消息, 直接返回
+    vector<pair<TcpConnectionPtr, FramePtr>> pending;
+    takePending(pending);
+    pending.insert(pending.end(), frames.begin(), frames.end());
+    sendFrames(pending);
+}
+
+// 取出队列中所有待发送的消息帧
+void DeliveryQueue::takePending(vector<pair<TcpConnectionPtr, FramePtr>> &pending)
+{
+    pair<TcpConnectionPtr, FramePtr> item;
+    while (_pending.pop(item))
+    {
+        pending.push_back(std::move(item));
+    }
+}
+
+// 按连接合并消息帧并发送
+void DeliveryQueue::sendFrames(const vector<pair<TcpConnectionPtr, FramePtr>> &pending)
+{
+    // 按连接合并消息帧, 同一个连接的消息保持入队顺序
+    vector<pair<TcpConnectionPtr, Buffer>> batches;
+    unordered_map<TcpConnection *, size_t> index; // 连接 => 在batches中的下标
+    vector<int64_t> frameCounts;
+    int64_t bytes = 0;
+    for (const auto &item : pending)
+    {
+        auto it = index.find(item.first.get());
+        if (it == index.end())
+        {
+            it = index.insert({item.first.get(), batches.size()}).first;
+            batches.emplace_back(item.first, Buffer());
+            frameCounts.push_back(0);
+        }
+
+        Buffer &buf = batches[it->second].second;
+        const string &frame = *item.second;
+        buf.appendInt32(static_cast<int32_t>(frame.size())); // 长度头, 与ChatCodec的帧格式一致
+        buf.append(frame.data(), frame.size());
+        ++frameCounts[it->second];
+        bytes += ChatCodec::kHeaderLen + frame.size();
+    }
+
+    // 每个连接只发送一次, 在loop线程中TcpConnection::send会直接尝试write
+    for (auto &batch : batches)
+    {
+        batch.first->send(&batch.second);
+    }
+
+    Metrics *metrics = Metrics::instance();
+    metrics->deliveryWrites += batches.size();
+    metrics->deliveryFrames += pending.size();
+    metrics->deliveryBytes += bytes;
+    for (int64_t count : frameCounts)
+    {
+        Metrics::updateMax(metrics->deliveryMaxBatch, count);
+    }
+}
@@ -1,7 +1,14 @@
 #include "chatserver.hpp"
 #include "chatservice.hpp"
+#include "config.hpp"
+#include "admission.hpp"
+#include "sessionrouter.hpp"
+#include "dbrouter.hpp"
+#include <muduo/net/EventLoopThread.h>
 #include <iostream>
 #include <signal.h>
+#include <memory>
+#include <vector>
 using namespace std;
 
 // 处理服务器被ctrl+C强制中断后,重置用户状态信息
@@ -13,21 +20,70 @@ void resetHandler(int)
 
 int main(int argc, char **argv)
 {
-    if (argc < 3) // 命令中必须提供两个参数: IP地址、端口号
+    // 读取配置文件和命令行选项, 命令行选项优先
+    ServerConfig config;
+    string err;
+    if (!config.parseArgs(argc, argv, err))
     {
-        cerr << "command invalid! example: ./ChatServer 127.0.0.1 6000" << endl;
+        cerr << "command invalid! " << err << endl;
+        cerr << ServerConfig::usage() << endl;
         exit(-1);
     }
 
-    // 解析通过命令行参数传递的ip和port
-    char *ip = argv[1];
-    uint16_t port = atoi(argv[2]);
-
     signal(SIGINT, resetHandler);
 
+    // 新连接和登录请求的准入速率, 所有acceptor共享
+    AdmissionControl::instance()->configure(config);
+
+    // 按用户划分归属IO线程时, 每个IO线程一个会话表分片, 必须在IO线程启动之前创建
+    if (config.homeLoops)
+    {
+        SessionRouter::instance()->init(static_cast<size_t>(config.acceptors) * config.ioThreadsPerAcceptor());
+    }
+
+    // 预先建立MySQL主库和从库的连接, 所有Model通过DbRouter取连接, 写主库, 只读操作分配到从库
+    DbEndpoint primary;
+    primary.host = config.dbHost;
+    primary.port = config.dbPort;
+    primary.user = config.dbUser;
+    primary.password = config.dbPassword;
+    primary.dbname = config.dbName;
+    vector<DbEndpoint> replicas;
+    for (auto &hostPort : config.dbReplicas)
+    {
+        DbEndpoint replica = primary;
+        replica.host = hostPort.first;
+        replica.port = hostPort.second;
+        replicas.push_back(replica);
+    }
+    DbRouter::instance()->init(primary, replicas, config.dbPoolMin, config.dbPoolMax,
+                               config.dbIdleTimeout, config.dbWaitTimeoutMs, config.dbMaxReplicaLag);
+
+    // 启动业务线程池, 阻塞的数据库操作不在IO线程中执行
+    ChatService::instance()->startWorkers(config.workerThreads);
+
+    // 离线消息合并成多行INSERT批量写入
+    ChatService::instance()->startOfflineWriter(config.offlineBatchMs, config.offlineBatchRows, config.offlineQueueMax);
+
     EventLoop loop;
-    InetAddress addr(ip, port);
-    ChatServer server(&loop, addr, "ChatServer");
+    InetAddress addr(config.ip, config.port);
+    ChatServer server(&loop, addr, "ChatServer", config, 0);
+
+    // 多acceptor模式: 其余的acceptor各自运行在独立的EventLoop线程中, 以SO_REUSEPORT监听同一端口
+    vector<unique_ptr<EventLoopThread>> acceptorThreads;
+    vector<unique_ptr<ChatServer>> acceptorServers;
+    for (int i = 1; i < config.acceptors; ++i)
+    {
+        acceptorThreads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "acceptor" + to_string(i)));
+        EventLoop *acceptorLoop = acceptorThreads.back()->startLoop();
+        acceptorServers.emplace_back(new ChatServer(acceptorLoop, addr, "ChatServer" + to_string(i), config, i));
+
+        ChatServer *acceptorServer = acceptorServers.back().get();
+        acceptorLoop->runInLoop([acceptorServer]()
+        {
+            acceptorServer->start(); // TcpServer::start必须在其EventLoop所在的线程中调用
+        });
+    }
 
     server.start(); // 启动服务, 将listenfd epoll_ctl添加到epoll中
     loop.loop();    // epoll_wait以阻塞方式等待新用户连接、已连接用户的读写事件等
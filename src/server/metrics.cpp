@@ -0,0 +1,74 @@
+#include "metrics.hpp"
+#include <sstream>
+
+// 获取单例对象的接口函数
+Metrics *Metrics::instance()
+{
+    static Metrics metrics;
+    return &metrics;
+}
+
+// 原子地更新最大值
+void Metrics::updateMax(atomic<int64_t> &target, int64_t value)
+{
+    int64_t current = target.load(memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, memory_order_relaxed))
+    {
+    }
+}
+
+// 将当前所有指标格式化成一行文本
+string Metrics::report() const
+{
+    int64_t flushes = deliveryFlushes.load();
+    int64_t writes = deliveryWrites.load();
+    int64_t frames = deliveryFrames.load();
+    int64_t tasks = workerTasks.load();
+    int64_t acquires = dbAcquires.load();
+    int64_t created = dbCreatedConnections.load();
+    int64_t closed = dbClosedConnections.load();
+    int64_t offlineBatchCount = offlineBatches.load();
+    int64_t offlineFlushCount = offlineFlushes.load();
+
+    ostringstream os;
+    os << "accepted=" << acceptedConnections.load()
+       << " idleEvicted=" << idleEvictions.load()
+       << " admission{rejectedConn=" << rejectedConnections.load()
+       << " rejectedLogin=" << rejectedLogins.load()
+       << "} workers{tasks=" << tasks
+       << " avgWaitUs=" << (tasks > 0 ? workerWaitMicros.load() / tasks : 0)
+       << " maxWaitUs=" << workerMaxWaitMicros.load()
+       << "} db{acquires=" << acquires
+       << " avgWaitUs=" << (acquires > 0 ? dbWaitMicros.load() / acquires : 0)
+       << " maxWaitUs=" << dbMaxWaitMicros.load()
+       << " timeouts=" << dbWaitTimeouts.load()
+       << " open=" << created - closed
+       << " created=" << created
+       << " closed=" << closed
+       << " replicaReads=" << dbReplicaReads.load()
+       << " replicaFallbacks=" << dbReplicaFallbacks.load()
+       << "} offline{flushes=" << offlineFlushCount
+       << " batches=" << offlineBatchCount
+       << " rows=" << offlineRows.load()
+       << " avgBatch=" << (offlineBatchCount > 0 ? static_cast<double>(offlineRows.load()) / offlineBatchCount : 0.0)
+       << " maxBatch=" << offlineMaxBatch.load()
+       << " failed=" << offlineFailedRows.load()
+       << " avgFlushUs=" << (offlineFlushCount > 0 ? offlineFlushMicros.load() / offlineFlushCount : 0)
+       << " maxFlushUs=" << offlineMaxFlushMicros.load()
+       << " queueFull=" << offlineQueueFull.load()
+       << "} router{commands=" << routerCommands.load()
+       << " direct=" << routerDirectFrames.load()
+       << "} delivery{flushes=" << flushes
+       << " writes=" << writes
+       << " frames=" << frames
+       << " bytes=" << deliveryBytes.load()
+       << " avgBatch=" << (writes > 0 ? static_cast<double>(frames) / writes : 0.0)
+       << " maxBatch=" << deliveryMaxBatch.load()
+       << " avgFlushUs=" << (flushes > 0 ? deliveryFlushMicros.load() / flushes : 0)
+       << " maxFlushUs=" << deliveryMaxFlushMicros.load()
+       << "} backpressure{throttled=" << throttledConnections.load()
+       << " events=" << throttleEvents.load()
+       << " spilled=" << spilledMessages.load()
+       << "}";
+    return os.str();
+}
@@ -1,5 +1,6 @@
 #include "groupmodel.hpp"
-#include "db.h"
+#include "dbrouter.hpp"
+#include "statement.hpp"
 
 // 创建群组
 bool GroupModel::createGroup(Group &group)
@@ -11,13 +12,13 @@ bool GroupModel::createGroup(Group &group)
     sprintf(sql, "insert into allgroup(groupname, groupdesc) values('%s', '%s')",
             group.getName().c_str(), group.getDesc().c_str());
 
-    MySQL mysql;
-    if (mysql.connect()) // 数据库连接成功
+    shared_ptr<MySQL> mysql = DbRouter::instance()->primary();
+    if (mysql != nullptr) // 从连接池取到了可用的连接
     {
-        if (mysql.update(sql)) // 将插入语句传给数据库更新函数update,若数据库更新成功
+        if (mysql->update(sql)) // 将插入语句传给数据库更新函数update,若数据库更新成功
         {
-            // mysql_insert_id(mysql.getConnection()): 获取本次数据库连接执行insert语句生成的自增的群组id值
-            group.setId(mysql_insert_id(mysql.getConnection())); // 设置新群组的群组id
+            // mysql_insert_id(mysql->getConnection()): 获取本次数据库连接执行insert语句生成的自增的群组id值
+            group.setId(mysql_insert_id(mysql->getConnection())); // 设置新群组的群组id
             return true;
         }
     }
@@ -34,10 +35,10 @@ void GroupModel::addGroup(int userid, int groupid, string role)
     sprintf(sql, "insert into groupuser values(%d, %d, '%s')",
             groupid, userid, role.c_str());
 
-    MySQL mysql;
-    if (mysql.connect()) // 数据库连接成功
+    shared_ptr<MySQL> mysql = DbRouter::instance()->primary();
+    if (mysql != nullptr) // 从连接池取到了可用的连接
     {
-        mysql.update(sql); // 将插入语句传给数据库更新函数update,更新数据库
+        mysql->update(sql); // 将插入语句传给数据库更新函数update,更新数据库
     }
 }
 
@@ -46,67 +47,49 @@ void GroupModel::addGroup(int userid, int groupid, string role)
 vector<Group> GroupModel::queryGroups(int userid)
 {
     /*
-    1. 先根据userid在groupuser表中查询出该用户所属的群组信息
-    2. 再根据群组信息，查询属于该群组的所有用户的userid，并且和user表进行多表联合查询，查出用户的详细信息
+    用一条联合查询取出该用户所属的所有群组, 以及每个群组中所有成员的详细信息:
+    b是该用户的群组关系, a是群组信息, m是这些群组的全部成员关系, u是成员的用户信息
+    结果按群组id排序, 同一个群组的成员是连续的行, 逐行读取时遇到新的群组id就开始一个新的群组
+    原来先查群组再逐个群组查成员, 用户加入N个群组时登录要N+1次往返, 现在只需一次, 耗时只随返回的行数增长
     */
-
-    // 组装sql语句,并存入sql字符数组
-    char sql[1024] = {0};
-
-    sprintf(sql, "select a.id, a.groupname, a.groupdesc from allgroup a \
-            inner join groupuser b on a.id = b.groupid where b.userid = %d",
-            userid);
-
     vector<Group> groupVec; // 存储用户userid的所有群组和各群组中所有组员用户的信息
 
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = DbRouter::instance()->replica(); // 只读操作使用从库
+    if (mysql == nullptr) // 没有取到可用的连接
     {
-        // 将查询语句传给数据库的查询函数query,返回MYSQL_RES型指针res
-        // 指针 res 指向的结果集 MYSQL_RES 是在 MySQL C API 内部动态分配的内存，用于存储查询结果
-        MYSQL_RES *res = mysql.query(sql);
-        
-        if (res != nullptr) // 查询成功
-        {
-            // mysql_fetch_row: 获取结果集的一行 (这里的结果集只有一行,因为id是主键,是唯一的)
-            // MYSQL_ROW 是一个指向字符串数组的指针,数组的每个元素对应user表的一个字段的字符串类型数据
-            MYSQL_ROW row;
-
-            // 查询该用户userid所有群组的信息,并把该用户的所有群组放入群组列表groupVec中
-            while ((row = mysql_fetch_row(res)) != nullptr)
-            {
-                Group group;
-                group.setId(atoi(row[0])); // row[0]存的是组id
-                group.setName(row[1]);     // row[1]存的是组名
-                group.setDesc(row[2]);     // row[2]存的是组描述
-                groupVec.push_back(group); // 将该群组添加到群组列表groupVec中
-            }
-            mysql_free_result(res); // 释放资源
-        }
+        return groupVec;
     }
 
-    // 查询该用户userid所有群组中的成员用户信息
-    for (Group &group : groupVec)
+    Statement stmt(*mysql, "select a.id, a.groupname, a.groupdesc, u.id, u.name, u.state, m.grouprole "
+                           "from groupuser b "
+                           "inner join allgroup a on a.id = b.groupid "
+                           "inner join groupuser m on m.groupid = b.groupid "
+                           "inner join user u on u.id = m.userid "
+                           "where b.userid = ? order by a.id");
+    stmt.bind(userid);
+    if (!stmt.execute())
     {
-        sprintf(sql, "select a.id, a.name, a.state, b.grouprole from user a \
-                inner join groupuser b on b.userid = a.id where b.groupid = %d",
-                group.getId());
+        return groupVec;
+    }
 
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+    while (stmt.fetch())
+    {
+        int groupid = static_cast<int>(stmt.getInt(0));
+        if (groupVec.empty() || groupVec.back().getId() != groupid) // 新的群组
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
-            {
-                GroupUser user;
-                user.setId(atoi(row[0]));         // row[0]存的是用户id
-                user.setName(row[1]);             // row[1]存的是用户名
-                user.setState(row[2]);            // row[2]存的是用户状态
-                user.setRole(row[3]);             // row[3]存的是用户在群组中的角色
-                group.getUsers().push_back(user); // 将该用户添加到该群组的成员列表中
-            }
-            mysql_free_result(res); // 释放资源
+            groupVec.emplace_back();
+            Group &group = groupVec.back();
+            group.setId(groupid);                // 第0列是组id
+            group.setName(stmt.getString(1));    // 第1列是组名
+            group.setDesc(stmt.getString(2));    // 第2列是组描述
         }
+
+        GroupUser user;
+        user.setId(static_cast<int>(stmt.getInt(3))); // 第3列是用户id
+        user.setName(stmt.getString(4));              // 第4列是用户名
+        user.setState(stmt.getString(5));             // 第5列是用户状态
+        user.setRole(stmt.getString(6));              // 第6列是用户在群组中的角色
+        groupVec.back().getUsers().push_back(user);   // 将该用户添加到该群组的成员列表中
     }
     return groupVec; // 返回该用户userid的群组列表
 }
@@ -115,25 +98,20 @@ vector<Group> GroupModel::queryGroups(int userid)
 // 查询群组groupid中除了用户userid之外的其他组员的用户id,主要用户群聊业务给群组其它成员群发消息
 vector<int> GroupModel::queryGroupUsers(int userid, int groupid)
 {
-    // 组装sql语句,并存入sql字符数组
-    char sql[1024] = {0};
-
-    sprintf(sql, "select userid from groupuser where groupid = %d and userid != %d", groupid, userid);
-
     vector<int> idVec; // 存储群组groupid中除了用户userid之外的其他组员用户的id
     
-    MySQL mysql;
-    if (mysql.connect()) // 连接成功
+    shared_ptr<MySQL> mysql = DbRouter::instance()->replica(); // 只读操作使用从库
+    if (mysql != nullptr) // 从连接池取到了可用的连接
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr) // 查询成功
+        // 每条群聊消息都要执行, 使用预处理语句
+        Statement stmt(*mysql, "select userid from groupuser where groupid = ? and userid != ?");
+        stmt.bind(groupid).bind(userid);
+        if (stmt.execute())
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            while (stmt.fetch())
             {
-                idVec.push_back(atoi(row[0])); // 将该用户的id存到id列表中
+                idVec.push_back(static_cast<int>(stmt.getInt(0))); // 将该用户的id存到id列表中
             }
-            mysql_free_result(res); // 释放资源
         }
     }
     return idVec; // 返回群组中除userid之外的其他组员的id列表
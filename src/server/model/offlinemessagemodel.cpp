@@ -1,64 +1,89 @@
 #include "offlinemessagemodel.hpp"
-#include "db.h"
+#include "dbrouter.hpp"
+#include "statement.hpp"
 
 // 存储用户的离线消息
-void offlineMsgModel::insert(int userid, string msg)
+void offlineMsgModel::insert(int userid, const string &msg)
 {
-    // 组装插入语句,并存入sql字符数组
-    char sql[1024] = {0};
+    shared_ptr<MySQL> mysql = DbRouter::instance()->primary();
+    if (mysql != nullptr) // 从连接池取到了可用的连接
+    {
+        // 消息内容作为参数传给服务器, 不再拼接到SQL中: 不会被截断到1024字节, 也不会因为消息中的引号出错或被注入
+        Statement stmt(*mysql, "insert into offlinemessage(userid, message) values(?, ?)");
+        stmt.bind(userid).bind(msg);
+        stmt.execute();
+    }
+}
 
-    sprintf(sql, "insert into offlinemessage values(%d, '%s')", userid, msg.c_str());
+// 用一条多行INSERT存储多条离线消息
+bool offlineMsgModel::insertBatch(const pair<int, string> *msgs, size_t count, bool &retryable)
+{
+    retryable = true;
+    shared_ptr<MySQL> mysql = DbRouter::instance()->primary();
+    if (mysql == nullptr) // 没有取到可用的连接, 语句没有发出
+    {
+        return false;
+    }
 
-    MySQL mysql;
-    if (mysql.connect()) // 数据库连接成功
+    // 行数不固定, 无法缓存预处理语句, 消息内容转义后拼接
+    string sql = "insert into offlinemessage(userid, message) values";
+    for (size_t i = 0; i < count; ++i)
     {
-        mysql.update(sql); // 将插入语句传给数据库更新函数update,若数据库更新成功
+        sql += i == 0 ? "(" : ",(";
+        sql += to_string(msgs[i].first);
+        sql += ",'";
+        sql += mysql->escape(msgs[i].second);
+        sql += "')";
     }
+    if (mysql->update(sql))
+    {
+        return true;
+    }
+
+    // CR_SERVER_GONE_ERROR: 连接在发送语句时已经断开; ER_LOCK_WAIT_TIMEOUT、ER_LOCK_DEADLOCK: 服务器已回滚该语句
+    // 其它错误(如执行中途连接断开的CR_SERVER_LOST)无法确定是否已经提交, 或者重试也不会成功
+    unsigned int err = mysql_errno(mysql->getConnection());
+    retryable = err == 2006 || err == 1205 || err == 1213;
+    return false;
 }
 
-// 删除用户的离线消息
-void offlineMsgModel::remove(int userid)
+// 删除用户id不超过maxId的离线消息
+void offlineMsgModel::removeUpTo(int userid, int64_t maxId)
 {
-    // 组装插入语句,并存入sql字符数组
+    // 组装删除语句,并存入sql字符数组
+    // 按(userid, id)索引范围删除, 只删除客户端确认收到的消息, 之后新存入的消息id更大, 不会被误删
     char sql[1024] = {0};
 
-    sprintf(sql, "delete from offlinemessage where userid = %d", userid);
+    sprintf(sql, "delete from offlinemessage where userid = %d and id <= %lld", userid, static_cast<long long>(maxId));
 
-    MySQL mysql;
-    if (mysql.connect()) // 数据库连接成功
+    shared_ptr<MySQL> mysql = DbRouter::instance()->primary();
+    if (mysql != nullptr) // 从连接池取到了可用的连接
     {
-        mysql.update(sql); // 将插入语句传给数据库更新函数update,若数据库更新成功
+        mysql->update(sql); // 将插入语句传给数据库更新函数update,若数据库更新成功
     }
 }
 
-// 查询用户的离线消息,可能有多条,查到的消息用vector容器存储
-vector<string> offlineMsgModel::query(int userid)
+// 按id顺序逐条读取用户id大于afterId的离线消息, 最多limit条, 返回之后是否还有更多的离线消息
+bool offlineMsgModel::fetch(int userid, int64_t afterId, size_t limit, const function<void(int64_t, string_view)> &func)
 {
-    // 组装查询语句,并存入sql字符数组
+    // 组装查询语句,并存入sql字符数组, 多取一条用来判断之后是否还有消息
     char sql[1024] = {0};
-    sprintf(sql, "select message from offlinemessage where userid = %d", userid);
+    sprintf(sql, "select id, message from offlinemessage where userid = %d and id > %lld order by id limit %zu",
+            userid, static_cast<long long>(afterId), limit + 1);
 
-    vector<string> vec; // 存储查询到的所有离线消息
-    MySQL mysql;
-    if (mysql.connect()) // 数据库连接成功
+    size_t count = 0;
+    shared_ptr<MySQL> mysql = DbRouter::instance()->primary();
+    if (mysql != nullptr) // 从连接池取到了可用的连接
     {
-        // 将查询语句传给数据库的查询函数query,返回MYSQL_RES型指针res
-        // 指针 res 指向的结果集 MYSQL_RES 是在 MySQL C API 内部动态分配的内存，用于存储查询结果
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr) // 查询成功
+        // 结果集逐行读取, 同一时刻只有一条消息在内存中
+        for (const Row &row : mysql->cursor(sql))
         {
-            // mysql_fetch_row: 获取结果集的一行 (这里的结果集只有一行,因为id是主键,是唯一的)
-            // MYSQL_ROW 是一个指向字符串数组的指针,数组的每个元素对应user表的一个字段的字符串类型数据
-            MYSQL_ROW row;
-            
-            // 把该用户的所有离线消息放入vec中,然后返回vec
-            while((row = mysql_fetch_row(res)) != nullptr)
+            if (++count > limit)
             {
-                vec.push_back(row[0]); // 只查询了message字段,故row[0]存的就是离线消息
+                return true;
             }
-            mysql_free_result(res); // 释放资源
-            return vec;
+            func(row.getInt(0), row.getStringView(1)); // 第0列是消息id, 第1列是离线消息
         }
     }
-    return vec;
+    return false;
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "usermodel.hpp"
-#include "db.h"
+#include "dbrouter.hpp"
+#include "statement.hpp"
 #include <iostream>
 using namespace std;
 
@@ -13,63 +14,72 @@ bool UserModel::insert(User &user)
     sprintf(sql, "insert into user(name, password, state) values('%s', '%s', '%s')",
             user.getName().c_str(), user.getPwd().c_str(), user.getState().c_str());
 
-    MySQL mysql;
-    if (mysql.connect()) // 数据库连接成功
+    shared_ptr<MySQL> mysql = DbRouter::instance()->primary();
+    if (mysql != nullptr) // 从连接池取到了可用的连接
     {
-        if (mysql.update(sql)) // 将插入语句传给数据库更新函数update,若数据库更新成功
+        if (mysql->update(sql)) // 将插入语句传给数据库更新函数update,若数据库更新成功
         {
             // mysql_insert_id函数: 获取插入成功的用户数据生成的主键id
-            user.setId(mysql_insert_id(mysql.getConnection()));
+            user.setId(mysql_insert_id(mysql->getConnection()));
             return true;
         }
     }
     return false;
 }
 
-// 根据用户id查询用户信息
-User UserModel::query(int id)
+// 在连接mysql上根据用户id查询用户信息
+static User queryUser(const shared_ptr<MySQL> &mysql, int id)
 {
-    // 组装查询语句,并存入sql字符数组
-    char sql[1024] = {0};
-    sprintf(sql, "select * from user where id = %d", id);
-
-    MySQL mysql;
-    if (mysql.connect()) // 数据库连接成功
+    if (mysql != nullptr) // 从连接池取到了可用的连接
     {
-        // 将查询语句传给数据库的查询函数query,返回MYSQL_RES型指针res
-        // 指针 res 指向的结果集 MYSQL_RES 是在 MySQL C API 内部动态分配的内存，用于存储查询结果
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr) // 查询成功
-        {
-            // mysql_fetch_row: 获取结果集的一行 (这里的结果集只有一行,因为id是主键,是唯一的)
-            // MYSQL_ROW 是一个指向字符串数组的指针,数组的每个元素对应user表的一个字段的字符串类型数据
-            MYSQL_ROW row = mysql_fetch_row(res);
-            if (row != nullptr) // 行不为空,即行中有数据
-            {
-                User user;
+        // 登录时每次都要执行的查询, 使用预处理语句, id以二进制参数传给服务器
+        Statement stmt(*mysql, "select id, name, password, state from user where id = ?");
+        stmt.bind(id);
 
-                // row[0] 存第一个字段id的数据
-                user.setId(atoi(row[0])); // 将id字段数据类型从字符串转为整数
+        // 结果集只有一行,因为id是主键,是唯一的
+        if (stmt.execute() && stmt.fetch())
+        {
+            User user;
+            user.setId(static_cast<int>(stmt.getInt(0))); // id列以整数绑定, 不需要atoi
+            user.setName(stmt.getString(1));
+            user.setPwd(stmt.getString(2));
+            user.setState(stmt.getString(3));
+            return user;
+        }
+    }
 
-                // row[1] 存第二个字段name的数据
-                user.setName(row[1]);
+    // 没有找到该用户id的数据
+    return User(); // 构造函数User()创建一个id=-1的错误用户并作为返回值
+}
 
-                // row[2] 存第三个字段password的数据
-                user.setPwd(row[2]);
+// 根据用户id查询用户信息, 读从库
+User UserModel::query(int id)
+{
+    return queryUser(DbRouter::instance()->replica(), id); // 只用于展示, 允许稍有延迟
+}
 
-                // row[3] 存第三个字段state的数据
-                user.setState(row[3]);
+// 根据用户id查询用户信息, 读主库
+User UserModel::queryPrimary(int id)
+{
+    // 刚注册的用户和刚变化的在线状态在从库上可能还看不到, 登录校验必须读主库
+    return queryUser(DbRouter::instance()->primary(), id);
+}
 
-                // 释放指针res的资源,否则内存不断泄露,
-                // 因为每次调用 mysql.query() 都会分配新的内存给新结果集，而旧结果集的内存没有被正确地释放。
-                mysql_free_result(res);
-                return user;
-            }
+// 查询用户的在线状态, 读主库
+string UserModel::queryState(int id)
+{
+    shared_ptr<MySQL> mysql = DbRouter::instance()->primary(); // 在线状态决定消息的投递方式, 不能读到延迟的数据
+    if (mysql != nullptr) // 从连接池取到了可用的连接
+    {
+        // 每条发给不在本服务器上的用户的消息都要执行, 使用预处理语句, 只查询state列
+        Statement stmt(*mysql, "select state from user where id = ?");
+        stmt.bind(id);
+        if (stmt.execute() && stmt.fetch())
+        {
+            return stmt.getString(0);
         }
     }
-
-    // 没有找到该用户id的数据
-    return User(); // 构造函数User()创建一个id=-1的错误用户并作为返回值
+    return string();
 }
 
 // 更新用户的状态信息
@@ -79,10 +89,10 @@ bool UserModel::updateState(User user)
     char sql[1024] = {0};
     sprintf(sql, "update user set state = '%s' where id = %d", user.getState().c_str(), user.getId());
 
-    MySQL mysql;
-    if (mysql.connect()) // 数据库连接成功
+    shared_ptr<MySQL> mysql = DbRouter::instance()->primary();
+    if (mysql != nullptr) // 从连接池取到了可用的连接
     {
-        if (mysql.update(sql)) // 将状态更新语句传给数据库更新函数update,若数据库更新成功
+        if (mysql->update(sql)) // 将状态更新语句传给数据库更新函数update,若数据库更新成功
         {
             return true;
         }
@@ -96,9 +106,9 @@ void UserModel::resetState()
     // 组装状态更新语句,并存入sql字符数组
     char sql[1024] = "update user set state = 'offline' where state = 'online'";
 
-    MySQL mysql;
-    if (mysql.connect()) // 数据库连接成功
+    shared_ptr<MySQL> mysql = DbRouter::instance()->primary();
+    if (mysql != nullptr) // 从连接池取到了可用的连接
     {
-        mysql.update(sql); // 将状态更新语句传给数据库更新函数update,若数据库更新成功
+        mysql->update(sql); // 将状态更新语句传给数据库更新函数update,若数据库更新成功
     }
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "msgrequest.hpp"
+
+// 读取整数字段, 字段不存在或不是整数时返回false
+static bool getInt(const json &js, const char *key, int &value)
+{
+    auto it = js.find(key);
+    if (it == js.end() || !it->is_number_integer())
+    {
+        return false;
+    }
+    value = it->get<int>();
+    return true;
+}
+
+// 读取字符串字段, 字段不存在或不是字符串时返回false
+static bool getString(const json &js, const char *key, string &value)
+{
+    auto it = js.find(key);
+    if (it == js.end() || !it->is_string())
+    {
+        return false;
+    }
+    value = it->get<string>();
+    return true;
+}
+
+// 可选的字符串字段, 字段不存在或是字符串时返回true
+static bool optionalString(const json &js, const char *key)
+{
+    auto it = js.find(key);
+    return it == js.end() || it->is_string();
+}
+
+// 检查聊天消息各字段的类型, 聊天消息原样转发给接收方,
+// 转换成二进制格式或在其它服务器上解析时不能因为类型不对而出错
+static bool checkChatFields(const json &js, int &fromid)
+{
+    string msg;
+    return getInt(js, "id", fromid) && getString(js, "msg", msg) && optionalString(js, "name") && optionalString(js, "time");
+}
+
+// 转发给接收方的聊天消息帧: 只包含聊天消息的字段时直接使用原始帧,
+// 否则(例如带有发送方用于匹配响应的reqId)只保留聊天消息的字段重新序列化, 避免接收方把它当作自己请求的响应
+static FramePtr chatRelayFrame(const json &js, const FramePtr &frame, const char *targetKey)
+{
+    static const char *const kChatKeys[] = {"msgId", "id", "name", "msg", "time"};
+    auto isChatKey = [targetKey](const string &key)
+    {
+        if (key == targetKey)
+        {
+            return true;
+        }
+        for (const char *chatKey : kChatKeys)
+        {
+            if (key == chatKey)
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    bool extra = false;
+    for (auto it = js.begin(); it != js.end() && !extra; ++it)
+    {
+        extra = !isChatKey(it.key());
+    }
+    if (!extra)
+    {
+        return frame;
+    }
+
+    json relay = json::object();
+    for (auto it = js.begin(); it != js.end(); ++it)
+    {
+        if (isChatKey(it.key()))
+        {
+            relay[it.key()] = it.value();
+        }
+    }
+    return make_shared<const string>(relay.dump());
+}
+
+// 解码公共字段
+bool RequestBase::decodeBase(const json &js)
+{
+    auto it = js.find("reqId");
+    if (it == js.end())
+    {
+        return true;
+    }
+    if (!it->is_number_integer())
+    {
+        return false;
+    }
+    reqId = it->get<int64_t>();
+    return true;
+}
+
+// 把reqId回填到响应中
+void RequestBase::echoReqId(json &response) const
+{
+    if (reqId)
+    {
+        response["reqId"] = *reqId;
+    }
+}
+
+bool LoginRequest::decode(const json &js, const FramePtr &)
+{
+    auto it = js.find("binary"); // 可选字段, 旧客户端不携带
+    binary = it != js.end() && it->is_boolean() && it->get<bool>();
+    return getInt(js, "id", id) && getString(js, "password", password);
+}
+
+bool RegRequest::decode(const json &js, const FramePtr &)
+{
+    return getString(js, "name", name) && getString(js, "password", password);
+}
+
+bool LoginoutRequest::decode(const json &js, const FramePtr &)
+{
+    return getInt(js, "id", id);
+}
+
+bool OneChatRequest::decode(const json &js, const FramePtr &frame)
+{
+    if (!getInt(js, "toid", toid) || !checkChatFields(js, id))
+    {
+        return false;
+    }
+    this->frame = chatRelayFrame(js, frame, "toid");
+    return true;
+}
+
+bool AddFriendRequest::decode(const json &js, const FramePtr &)
+{
+    return getInt(js, "id", id) && getInt(js, "friendid", friendid);
+}
+
+bool CreateGroupRequest::decode(const json &js, const FramePtr &)
+{
+    return getInt(js, "id", id) && getString(js, "groupname", groupname) && getString(js, "groupdesc", groupdesc);
+}
+
+bool AddGroupRequest::decode(const json &js, const FramePtr &)
+{
+    return getInt(js, "id", id) && getInt(js, "groupid", groupid);
+}
+
+bool GroupChatRequest::decode(const json &js, const FramePtr &frame)
+{
+    if (!getInt(js, "groupid", groupid) || !checkChatFields(js, id))
+    {
+        return false;
+    }
+    this->frame = chatRelayFrame(js, frame, "groupid");
+    return true;
+}
+
+bool OfflineAckRequest::decode(const json &js, const FramePtr &)
+{
+    auto it = js.find("lastId");
+    if (it == js.end() || !it->is_number_integer())
+    {
+        return false;
+    }
+    lastId = it->get<int64_t>();
+    return true;
+}
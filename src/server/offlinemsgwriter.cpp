@@ -0,0 +1,187 @@
+#include "offlinemsgwriter.hpp"
+#include "metrics.hpp"
+#include <muduo/base/Logging.h>
+
+// 一条多行INSERT语句中消息内容的最大总字节数, 避免超过服务器的max_allowed_packet
+static const size_t kMaxBatchBytes = 1024 * 1024;
+
+OfflineMsgWriter::~OfflineMsgWriter()
+{
+    stop();
+}
+
+// 启动写入线程
+void OfflineMsgWriter::start(int flushMs, size_t batchRows, size_t maxQueued)
+{
+    _flushInterval = chrono::milliseconds(flushMs);
+    _batchRows = max<size_t>(1, batchRows);
+    _maxQueued = max(_batchRows, maxQueued);
+    _running = true;
+    _thread = thread(&OfflineMsgWriter::run, this);
+}
+
+// 停止写入线程
+void OfflineMsgWriter::stop()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (!_running)
+        {
+            return;
+        }
+        _stopping = true;
+    }
+    _notEmpty.notify_one();
+    _thread.join();
+
+    lock_guard<mutex> lock(_mutex);
+    _running = false;
+    _written.notify_all();
+    _notFull.notify_all();
+}
+
+// 追加一条离线消息
+void OfflineMsgWriter::append(int userid, const string &msg)
+{
+    {
+        unique_lock<mutex> lock(_mutex);
+        if (_running && !_stopping)
+        {
+            if (_queue.size() >= _maxQueued)
+            {
+                Metrics::instance()->offlineQueueFull++;
+                _notFull.wait(lock, [this]() { return _queue.size() < _maxQueued || _stopping; });
+            }
+            if (!_stopping)
+            {
+                push(userid, msg);
+                return;
+            }
+        }
+    }
+
+    // 写入线程没有启动或已经停止, 直接写入
+    _model.insert(userid, msg);
+}
+
+// 不等待的追加
+bool OfflineMsgWriter::tryAppend(int userid, const string &msg)
+{
+    lock_guard<mutex> lock(_mutex);
+    if (!_running || _stopping)
+    {
+        return false;
+    }
+    if (_queue.size() >= _maxQueued)
+    {
+        Metrics::instance()->offlineQueueFull++;
+        return false;
+    }
+    push(userid, msg);
+    return true;
+}
+
+// 把消息放入队列并在需要时通知写入线程
+void OfflineMsgWriter::push(int userid, const string &msg)
+{
+    if (_queue.empty())
+    {
+        _firstQueued = chrono::steady_clock::now();
+    }
+    _queue.emplace_back(userid, msg);
+    ++_appendedCount;
+    if (_queue.size() == 1 || _queue.size() >= _batchRows)
+    {
+        _notEmpty.notify_one();
+    }
+}
+
+// 等待在此之前追加的所有离线消息都已写入数据库
+void OfflineMsgWriter::sync()
+{
+    unique_lock<mutex> lock(_mutex);
+    uint64_t target = _appendedCount;
+    if (!_running || _writtenCount >= target)
+    {
+        return;
+    }
+
+    ++_syncWaiters;
+    _notEmpty.notify_one(); // 不再等待凑批, 立即写入
+    _written.wait(lock, [this, target]() { return _writtenCount >= target || !_running; });
+    --_syncWaiters;
+}
+
+// 写入线程的主循环
+void OfflineMsgWriter::run()
+{
+    unique_lock<mutex> lock(_mutex);
+    for (;;)
+    {
+        _notEmpty.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+        if (_queue.empty()) // 需要退出, 且队列中的消息已经写完
+        {
+            return;
+        }
+
+        // 凑批: 等到第一条消息入队flushInterval之后, 或者凑够batchRows条, 或者有线程在sync
+        _notEmpty.wait_until(lock, _firstQueued + _flushInterval, [this]()
+        {
+            return _stopping || _syncWaiters > 0 || _queue.size() >= _batchRows;
+        });
+
+        vector<pair<int, string>> batch;
+        batch.swap(_queue);
+        uint64_t taken = _appendedCount;
+        _notFull.notify_all();
+
+        lock.unlock();
+        write(batch);
+        lock.lock();
+
+        _writtenCount = taken;
+        _written.notify_all();
+    }
+}
+
+// 把一批消息写入数据库, 每batchRows条或kMaxBatchBytes字节合并成一条多行INSERT
+void OfflineMsgWriter::write(vector<pair<int, string>> &batch)
+{
+    Metrics *metrics = Metrics::instance();
+    auto start = chrono::steady_clock::now();
+
+    size_t begin = 0;
+    while (begin < batch.size())
+    {
+        size_t end = begin;
+        size_t bytes = 0;
+        while (end < batch.size() && end - begin < _batchRows && (end == begin || bytes + batch[end].second.size() <= kMaxBatchBytes))
+        {
+            bytes += batch[end].second.size();
+            ++end;
+        }
+
+        // 确定没有写入时重试一次, 出错的连接已经被连接池丢弃, 重试会换一个连接;
+        // 无法确定是否已经提交时不重试, 宁可丢失这一批也不重复下发
+        size_t rows = end - begin;
+        bool retryable = false;
+        if (_model.insertBatch(batch.data() + begin, rows, retryable) ||
+            (retryable && _model.insertBatch(batch.data() + begin, rows, retryable)))
+        {
+            metrics->offlineBatches++;
+            metrics->offlineRows += rows;
+            Metrics::updateMax(metrics->offlineMaxBatch, static_cast<int64_t>(rows));
+        }
+        else
+        {
+            metrics->offlineFailedRows += rows;
+            LOG_ERROR << "offline message batch insert failed, " << rows << " messages lost";
+        }
+        begin = end;
+    }
+
+    int64_t micros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    metrics->offlineFlushes++;
+    metrics->offlineFlushMicros += micros;
+    Metrics::updateMax(metrics->offlineMaxFlushMicros, micros);
+}
@@ -51,10 +51,12 @@ bool Redis::connect()
 }
 
 // 向redis指定的通道channel发布消息
-bool Redis::publish(int channel, string message)
+bool Redis::publish(int channel, const string &message)
 {
     // redisCommand 函数返回值是 redisReply结构体
-    redisReply *reply = (redisReply *)redisCommand(_publish_context, "PUBLISH %d %s", channel, message.c_str()); // 输入publish命令, 发布消息
+    // %b 按指定长度传递消息内容, 不依赖'\0'结尾, 二进制内容也能原样发布
+    lock_guard<mutex> lock(_publishMutex);
+    redisReply *reply = (redisReply *)redisCommand(_publish_context, "PUBLISH %d %b", channel, message.data(), message.size()); // 输入publish命令, 发布消息
     if (nullptr == reply) // 发布消息失败
     {
         cerr << "publish command failed!" << endl;
@@ -70,6 +72,7 @@ bool Redis::subscribe(int channel)
     // SUBSCRIBE命令本身会造成线程阻塞等待通道里面发生消息，这里只做订阅通道，不接收通道消息
     // 通道消息的接收专门在observer_channel_message函数中的独立线程中进行
     // 只负责发送命令，不阻塞接收redis server响应消息，否则和notifyMsg线程抢占响应资源
+    lock_guard<mutex> lock(_subscribeMutex);
 
     // redisAppendCommand 函数作用是将命令写到本地缓存
     if (REDIS_ERR == redisAppendCommand(this->_subcribe_context, "SUBSCRIBE %d", channel))
@@ -96,6 +99,8 @@ bool Redis::subscribe(int channel)
 // 向redis指定的通道unsubscribe取消订阅消息
 bool Redis::unsubscribe(int channel)
 {
+    lock_guard<mutex> lock(_subscribeMutex);
+
     // redisAppendCommand函数作用是将命令写到本地缓存
     if (REDIS_ERR == redisAppendCommand(this->_subcribe_context, "UNSUBSCRIBE %d", channel))
     {
@@ -0,0 +1,205 @@
+#include "sessionrouter.hpp"
+#include "loopcontext.hpp"
+#include "metrics.hpp"
+
+// 获取单例对象的接口函数
+SessionRouter *SessionRouter::instance()
+{
+    static SessionRouter router;
+    return &router;
+}
+
+// 按IO线程总数创建分片
+void SessionRouter::init(size_t numLoops)
+{
+    for (size_t i = 0; i < numLoops; ++i)
+    {
+        _shards.emplace_back(new Shard);
+    }
+}
+
+// 把编号为index的分片绑定到该线程的EventLoop
+void SessionRouter::bindLoop(size_t index, EventLoop *loop)
+{
+    if (index >= _shards.size())
+    {
+        return;
+    }
+
+    // 绑定之前放入队列的命令(其它acceptor可能先开始接受连接)在这里补上一次drain
+    Shard *shard = _shards[index].get();
+    shard->loop.store(loop);
+    if (!shard->drainQueued.exchange(true))
+    {
+        loop->queueInLoop(std::bind(&SessionRouter::drain, this, shard));
+    }
+}
+
+// 在用户的归属线程中登记用户userid的连接
+void SessionRouter::registerSession(int userid, const TcpConnectionPtr &con)
+{
+    Command command;
+    command.type = Command::REGISTER;
+    command.userid = userid;
+    command.con = con;
+    post(*_shards[shardOf(userid)], std::move(command));
+}
+
+// 注销用户userid
+void SessionRouter::unregisterSession(int userid, const TcpConnectionPtr &con)
+{
+    Command command;
+    command.type = Command::UNREGISTER;
+    command.userid = userid;
+    command.con = con;
+    post(*_shards[shardOf(userid)], std::move(command));
+}
+
+// 在各个用户的归属线程中查找它们的连接并投递消息
+void SessionRouter::deliver(const vector<int> &userids, SendCallback send, MissingCallback missing)
+{
+    // 按归属分片归类, 每个涉及的分片只放入一条命令
+    vector<vector<int>> byShard(_shards.size());
+    for (int userid : userids)
+    {
+        byShard[shardOf(userid)].push_back(userid);
+    }
+
+    size_t parts = 0;
+    for (auto &ids : byShard)
+    {
+        parts += ids.empty() ? 0 : 1;
+    }
+    if (parts == 0)
+    {
+        vector<int> none;
+        missing(none);
+        return;
+    }
+
+    auto batch = make_shared<DeliverBatch>();
+    batch->send = std::move(send);
+    batch->missing = std::move(missing);
+    batch->parts.resize(parts);
+    batch->remaining.store(parts);
+
+    size_t part = 0;
+    for (size_t i = 0; i < byShard.size(); ++i)
+    {
+        if (byShard[i].empty())
+        {
+            continue;
+        }
+        Command command;
+        command.type = Command::DELIVER;
+        command.userids = std::move(byShard[i]);
+        command.batch = batch;
+        command.part = part++;
+        post(*_shards[i], std::move(command));
+    }
+}
+
+// 把命令放入分片的队列
+void SessionRouter::post(Shard &shard, Command command)
+{
+    shard.mailbox.push(std::move(command));
+    Metrics::instance()->routerCommands++;
+
+    // 一轮drain只需要提交一次, 分片还没有绑定IO线程时由bindLoop负责drain
+    EventLoop *loop = shard.loop.load();
+    if (loop != nullptr && !shard.drainQueued.exchange(true))
+    {
+        loop->queueInLoop(std::bind(&SessionRouter::drain, this, &shard));
+    }
+}
+
+// 在分片所在的IO线程中执行队列中的所有命令
+void SessionRouter::drain(Shard *shard)
+{
+    // 先清除标志再取命令, 之后入队的命令要么在本次被取出, 要么会提交新的drain
+    shard->drainQueued.store(false);
+
+    // 连接就在本线程中的消息帧, 本轮drain结束时按连接合并后直接发送
+    EventLoop *loop = shard->loop.load();
+    vector<pair<TcpConnectionPtr, FramePtr>> local;
+
+    Command command;
+    while (shard->mailbox.pop(command))
+    {
+        switch (command.type)
+        {
+        case Command::REGISTER:
+            shard->sessions[command.userid] = command.con;
+            break;
+        case Command::UNREGISTER:
+        {
+            auto it = shard->sessions.find(command.userid);
+            if (it != shard->sessions.end() && (!command.con || it->second == command.con))
+            {
+                shard->sessions.erase(it);
+            }
+            break;
+        }
+        case Command::DELIVER:
+        {
+            vector<int> &missing = command.batch->parts[command.part];
+            for (int userid : command.userids)
+            {
+                auto it = shard->sessions.find(userid);
+                if (it == shard->sessions.end())
+                {
+                    missing.push_back(userid);
+                    continue;
+                }
+
+                const TcpConnectionPtr &con = it->second;
+                FramePtr frame = command.batch->send(userid, con);
+                if (!frame)
+                {
+                    continue;
+                }
+                if (con->getLoop() == loop)
+                {
+                    local.emplace_back(con, std::move(frame));
+                }
+                else
+                {
+                    ChatCodec::send(con, frame); // 交给连接所在IO线程的DeliveryQueue
+                }
+            }
+
+            // 最后一个完成的分片合并所有分片的不在线用户
+            if (command.batch->remaining.fetch_sub(1) == 1)
+            {
+                vector<int> &merged = command.batch->parts[0];
+                for (size_t i = 1; i < command.batch->parts.size(); ++i)
+                {
+                    vector<int> &part = command.batch->parts[i];
+                    merged.insert(merged.end(), part.begin(), part.end());
+                }
+                command.batch->missing(merged);
+            }
+            break;
+        }
+        }
+        command = Command(); // 尽早释放命令持有的连接和投递
+    }
+
+    if (!local.empty())
+    {
+        // 排在本线程DeliveryQueue中已有的消息(包括登录应答等响应)之后发送, 同一个连接上的消息不会乱序
+        Metrics::instance()->routerDirectFrames += local.size();
+        LoopContext *context = getLoopContext(loop);
+        if (context != nullptr)
+        {
+            context->deliveryQueue.sendInLoop(local);
+        }
+        else
+        {
+            for (auto &item : local)
+            {
+                ChatCodec::send(item.first, item.second);
+            }
+        }
+    }
+}
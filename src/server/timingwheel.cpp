@@ -0,0 +1,58 @@
+#include "timingwheel.hpp"
+#include "metrics.hpp"
+#include <muduo/base/Logging.h>
+
+// 最后一个持有它的桶被清空, 连接已经空闲了idleSeconds秒
+TimingWheel::Entry::~Entry()
+{
+    TcpConnectionPtr con = weakConn.lock();
+    if (con && con->connected())
+    {
+        LOG_INFO << con->name() << " idle timeout, force close";
+        Metrics::instance()->idleEvictions++;
+
+        // 对端可能已经失联, shutdown只关闭写端等不到对端的回应, 这里直接关闭连接,
+        // 关闭后会走正常的连接断开回调, 由ChatService::clientCloseException清理用户状态
+        con->forceClose();
+    }
+}
+
+TimingWheel::TimingWheel(EventLoop *loop, int idleSeconds)
+    : _idleSeconds(idleSeconds), _buckets(idleSeconds > 0 ? idleSeconds : 0), _tail(0)
+{
+    if (_idleSeconds > 0)
+    {
+        loop->runEvery(1.0, std::bind(&TimingWheel::onTick, this));
+    }
+}
+
+// 新连接建立时调用
+TimingWheel::WeakEntryPtr TimingWheel::add(const TcpConnectionPtr &con)
+{
+    if (_idleSeconds <= 0)
+    {
+        return WeakEntryPtr();
+    }
+
+    EntryPtr entry = make_shared<Entry>(con);
+    _buckets[_tail].insert(entry);
+    return entry;
+}
+
+// 连接收到消息时调用, 把Entry放进当前的桶
+void TimingWheel::touch(const WeakEntryPtr &weakEntry)
+{
+    EntryPtr entry = weakEntry.lock();
+    if (entry)
+    {
+        _buckets[_tail].insert(entry);
+    }
+}
+
+// 每秒执行一次
+void TimingWheel::onTick()
+{
+    // 前进一格后, 新的当前桶就是最旧的桶, 清空它会释放其中已经空闲了idleSeconds秒的Entry
+    _tail = (_tail + 1) % _buckets.size();
+    _buckets[_tail].clear();
+}
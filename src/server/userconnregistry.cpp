@@ -0,0 +1,81 @@
+#include "userconnregistry.hpp"
+#include <algorithm>
+#include <mutex>
+
+// 记录用户userid的连接
+void UserConnRegistry::insert(int userid, const TcpConnectionPtr &con)
+{
+    Stripe &stripe = _stripes[stripeOf(userid)];
+    unique_lock<shared_mutex> lock(stripe.mtx);
+    stripe.conns[userid] = con;
+}
+
+// 删除用户userid的连接
+void UserConnRegistry::erase(int userid)
+{
+    Stripe &stripe = _stripes[stripeOf(userid)];
+    unique_lock<shared_mutex> lock(stripe.mtx);
+    stripe.conns.erase(userid);
+}
+
+// 查找用户userid的连接
+TcpConnectionPtr UserConnRegistry::find(int userid) const
+{
+    const Stripe &stripe = _stripes[stripeOf(userid)];
+    shared_lock<shared_mutex> lock(stripe.mtx);
+    auto it = stripe.conns.find(userid);
+    return it != stripe.conns.end() ? it->second : TcpConnectionPtr();
+}
+
+// 批量查找
+void UserConnRegistry::findMany(const vector<int> &userids, vector<pair<int, TcpConnectionPtr>> &found, vector<int> &missing) const
+{
+    // 先按分段排序, 每个分段只加一次读锁; 只分配一个数组, 不为每个分段单独分配
+    vector<pair<size_t, int>> byStripe;
+    byStripe.reserve(userids.size());
+    for (int userid : userids)
+    {
+        byStripe.emplace_back(stripeOf(userid), userid);
+    }
+    sort(byStripe.begin(), byStripe.end());
+
+    for (size_t begin = 0; begin < byStripe.size();)
+    {
+        size_t index = byStripe[begin].first;
+        size_t end = begin;
+        while (end < byStripe.size() && byStripe[end].first == index)
+        {
+            ++end;
+        }
+
+        const Stripe &stripe = _stripes[index];
+        shared_lock<shared_mutex> lock(stripe.mtx);
+        for (; begin < end; ++begin)
+        {
+            int userid = byStripe[begin].second;
+            auto it = stripe.conns.find(userid);
+            if (it != stripe.conns.end())
+            {
+                found.emplace_back(userid, it->second);
+            }
+            else
+            {
+                missing.push_back(userid);
+            }
+        }
+    }
+}
+
+// 用户userid的连接仍是con时才删除
+bool UserConnRegistry::eraseIf(int userid, const TcpConnectionPtr &con)
+{
+    Stripe &stripe = _stripes[stripeOf(userid)];
+    unique_lock<shared_mutex> lock(stripe.mtx);
+    auto it = stripe.conns.find(userid);
+    if (it == stripe.conns.end() || it->second != con)
+    {
+        return false;
+    }
+    stripe.conns.erase(it);
+    return true;
+}
@@ -0,0 +1,85 @@
+#include "workerpool.hpp"
+#include "metrics.hpp"
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+// 启动工作线程
+void WorkerPool::start(int numThreads)
+{
+    for (int i = 0; i < numThreads; ++i)
+    {
+        _workers.emplace_back(new Worker);
+    }
+    for (auto &worker : _workers)
+    {
+        worker->thr = thread(&WorkerPool::run, worker.get());
+    }
+}
+
+// 停止并回收所有工作线程
+void WorkerPool::stop()
+{
+    for (auto &worker : _workers)
+    {
+        {
+            lock_guard<mutex> lock(worker->mtx);
+            worker->stopping = true;
+        }
+        worker->cond.notify_one();
+    }
+    for (auto &worker : _workers)
+    {
+        if (worker->thr.joinable())
+        {
+            worker->thr.join();
+        }
+    }
+    _workers.clear();
+}
+
+// 把任务交给key对应的工作线程
+void WorkerPool::submit(size_t key, Task task)
+{
+    if (_workers.empty())
+    {
+        task();
+        return;
+    }
+
+    Worker *worker = _workers[key % _workers.size()].get();
+    {
+        lock_guard<mutex> lock(worker->mtx);
+        worker->tasks.emplace_back(std::move(task), Timestamp::now());
+    }
+    worker->cond.notify_one();
+}
+
+// 工作线程的主循环
+void WorkerPool::run(Worker *worker)
+{
+    for (;;)
+    {
+        pair<Task, Timestamp> item;
+        {
+            unique_lock<mutex> lock(worker->mtx);
+            worker->cond.wait(lock, [worker]() { return worker->stopping || !worker->tasks.empty(); });
+            if (worker->tasks.empty()) // stopping, 且任务已经执行完
+            {
+                return;
+            }
+            item = std::move(worker->tasks.front());
+            worker->tasks.pop_front();
+        }
+
+        // 记录任务在队列中的等待时间, 用于观察业务线程是否跟得上
+        int64_t waitMicros = Timestamp::now().microSecondsSinceEpoch() - item.second.microSecondsSinceEpoch();
+        Metrics::instance()->workerTasks++;
+        Metrics::instance()->workerWaitMicros += waitMicros;
+        Metrics::updateMax(Metrics::instance()->workerMaxWaitMicros, waitMicros);
+
+        item.first();
+    }
+}
@@ -0,0 +1,156 @@
+#include "admission.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+/*
+重启后的登录风暴测试
+1. 准入检查的耗时: 来自大量不同来源IP的连接同时到达, 记录的IP数达到上限后
+   - 原来的实现: 每次检查都遍历整个IP表清理已补满的IP, 风暴中几乎清理不出空位, 每次都是O(IP数)
+   - 现在的实现: 每个补满周期最多清理一次, 表满时新IP只检查全局令牌桶
+2. 恢复时间: 所有客户端在同一时刻重连, 被拒绝的客户端按retryAfter重试, 模拟时间中统计全部登录完成的耗时
+用法: benchadmission [客户端数] [来源IP数]
+*/
+
+// 原来的实现: 表满时每次都遍历整个IP表
+class SweepEveryCall
+{
+public:
+    SweepEveryCall(double rate, double ipRate)
+        : _global(rate, rate * 2), _ipRate(ipRate)
+    {
+    }
+
+    bool admit(const string &ip, double now)
+    {
+        if (_perIp.size() >= 10000)
+        {
+            for (auto it = _perIp.begin(); it != _perIp.end();)
+            {
+                it = it->second.full(now) ? _perIp.erase(it) : ++it;
+            }
+        }
+        auto it = _perIp.find(ip);
+        if (it == _perIp.end())
+        {
+            it = _perIp.emplace(ip, TokenBucket(_ipRate, _ipRate * 2)).first;
+        }
+        if (_global.wait(now) == 0 && it->second.wait(now) == 0)
+        {
+            _global.take();
+            it->second.take();
+            return true;
+        }
+        return false;
+    }
+
+private:
+    TokenBucket _global;
+    double _ipRate;
+    unordered_map<string, TokenBucket> _perIp;
+};
+
+static string ipOf(int i)
+{
+    return "10." + to_string((i >> 16) & 0xFF) + "." + to_string((i >> 8) & 0xFF) + "." + to_string(i & 0xFF);
+}
+
+// 每个来源IP发起一次连接, 返回每次准入检查的平均耗时(纳秒)
+template <typename Admit>
+static double admitCost(int numIps, Admit admit)
+{
+    vector<string> ips;
+    for (int i = 0; i < numIps; ++i)
+    {
+        ips.push_back(ipOf(i));
+    }
+
+    // 所有请求都在同一秒内到达, 与重启后的重连风暴一样
+    double now = AdmissionControl::now();
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < numIps; ++i)
+    {
+        admit(ips[i], now + i * 1e-6);
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e9 / numIps;
+}
+
+// 模拟时间中所有客户端同时重连并登录, 返回最后一个客户端登录成功的时间(秒), rejected返回被拒绝的次数
+static double recoveryTime(const ServerConfig &config, int numClients, int numIps, int64_t &rejected)
+{
+    AdmissionControl *admission = AdmissionControl::instance();
+    admission->configure(config);
+
+    // (时间, 客户端编号, 是否已经连接)
+    using Event = tuple<double, int, bool>;
+    priority_queue<Event, vector<Event>, greater<Event>> events;
+    double start = AdmissionControl::now();
+    for (int i = 0; i < numClients; ++i)
+    {
+        events.emplace(start, i, false);
+    }
+
+    rejected = 0;
+    double last = start;
+    while (!events.empty())
+    {
+        auto [now, client, connected] = events.top();
+        events.pop();
+
+        string ip = ipOf(client % numIps);
+        int retryAfter = connected ? admission->admitLogin(ip, now) : admission->admitConnection(ip, now);
+        if (retryAfter > 0)
+        {
+            ++rejected;
+            events.emplace(now + retryAfter / 1000.0, client, connected); // 被拒绝的连接重新连接, 登录重新发送
+        }
+        else if (!connected)
+        {
+            events.emplace(now + 0.001, client, true); // 连接建立后发送登录请求
+        }
+        else
+        {
+            last = now;
+        }
+    }
+    return last - start;
+}
+
+int main(int argc, char **argv)
+{
+    int numClients = argc > 1 ? atoi(argv[1]) : 50000;
+    int numIps = argc > 2 ? atoi(argv[2]) : 30000;
+
+    // 全局令牌桶不限制时, 每个IP的令牌都被取走了一个, 风暴期间清理不出任何空位
+    ServerConfig storm;
+    storm.connectRate = 1e9;
+    storm.ipRate = 20; // 按IP限流时才有IP表
+
+    SweepEveryCall old(storm.connectRate, storm.ipRate);
+    double oldNs = admitCost(numIps, [&old](const string &ip, double now) { old.admit(ip, now); });
+
+    AdmissionControl::instance()->configure(storm);
+    double newNs = admitCost(numIps, [](const string &ip, double now) { AdmissionControl::instance()->admitConnection(ip, now); });
+
+    cout << "source ips " << numIps << endl;
+    cout << "sweep every call: " << oldNs << " ns per admit" << endl;
+    cout << "time-gated sweep: " << newNs << " ns per admit" << endl;
+
+    ServerConfig config;
+    cout << "clients " << numClients << ", connect_rate " << config.connectRate << ", login_rate " << config.loginRate << endl;
+    for (double ipRate : {0.0, 20.0})
+    {
+        config.ipRate = ipRate;
+        int64_t rejected = 0;
+        double seconds = recoveryTime(config, numClients, numIps, rejected);
+        cout << "ip_rate " << ipRate << ": all logged in after " << seconds << " s, " << rejected << " rejections" << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "userconnregistry.hpp"
+#include "session.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+/*
+断线风暴测试: 大量在线用户中有一批连接同时断开时, 清理这些连接的耗时
+- 原来的实现: 在单个互斥锁下遍历整个用户连接表, 找到连接对应的用户id后删除, 每次断线O(在线用户数)
+- 现在的实现: 登录时把用户id记录在连接的会话上, 断线时直接取出, 再到分段连接表中删除, 每次断线O(1)
+用法: benchdisconnect [在线用户数] [断开的连接数]
+*/
+
+// 模拟的连接对象: 只用于比较和拷贝, 不会被解引用, 不需要真正建立连接
+static TcpConnectionPtr fakeConnection(int userid)
+{
+    return TcpConnectionPtr(shared_ptr<void>(), reinterpret_cast<TcpConnection *>(static_cast<uintptr_t>(userid) * 64));
+}
+
+// 原来的实现: 遍历用户连接表查找断开的连接
+static double scanCleanup(int numUsers, const vector<int> &closed)
+{
+    mutex connMutex;
+    unordered_map<int, TcpConnectionPtr> userConnMap;
+    for (int userid = 1; userid <= numUsers; ++userid)
+    {
+        userConnMap[userid] = fakeConnection(userid);
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (int userid : closed)
+    {
+        TcpConnectionPtr con = fakeConnection(userid);
+        lock_guard<mutex> lock(connMutex);
+        for (auto it = userConnMap.begin(); it != userConnMap.end(); ++it)
+        {
+            if (it->second == con)
+            {
+                userConnMap.erase(it);
+                break;
+            }
+        }
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// 现在的实现: 从会话中取出用户id, 在分段连接表中删除
+static double sessionCleanup(int numUsers, const vector<int> &closed)
+{
+    UserConnRegistry registry;
+    vector<SessionPtr> sessions(numUsers + 1);
+    for (int userid = 1; userid <= numUsers; ++userid)
+    {
+        registry.insert(userid, fakeConnection(userid));
+        sessions[userid] = make_shared<Session>();
+        sessions[userid]->userid = userid;
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (int closedId : closed)
+    {
+        TcpConnectionPtr con = fakeConnection(closedId);
+        int userid = sessions[closedId]->userid.exchange(-1); // 对应getSession(con)->userid
+        if (userid != -1)
+        {
+            registry.eraseIf(userid, con);
+        }
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    int numUsers = argc > 1 ? atoi(argv[1]) : 200000;
+    int numClosed = argc > 2 ? atoi(argv[2]) : 2000;
+    numClosed = min(numClosed, numUsers);
+
+    // 随机选出同时断开的连接
+    vector<int> userids(numUsers);
+    for (int i = 0; i < numUsers; ++i)
+    {
+        userids[i] = i + 1;
+    }
+    shuffle(userids.begin(), userids.end(), mt19937(1));
+    vector<int> closed(userids.begin(), userids.begin() + numClosed);
+
+    double scan = scanCleanup(numUsers, closed);
+    double session = sessionCleanup(numUsers, closed);
+
+    cout << "users " << numUsers << ", disconnects " << numClosed << endl;
+    cout << "scan:    " << scan * 1000 << " ms total, " << scan * 1e9 / numClosed << " ns per disconnect" << endl;
+    cout << "session: " << session * 1000 << " ms total, " << session * 1e9 / numClosed << " ns per disconnect" << endl;
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "userconnregistry.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+/*
+在线用户连接表的锁争用测试: 分段读写锁的UserConnRegistry 与 原来的单个互斥锁 + unordered_map
+每个线程模拟业务线程的访问: 大部分操作是群聊投递时批量查找成员的连接(findMany),
+少部分是登录(insert)和断线(eraseIf)
+用法: benchregistry [在线用户数] [每个线程的操作数] [群成员数]
+*/
+
+// 原来的实现: 所有操作都争抢同一个互斥锁
+class SingleLockRegistry
+{
+public:
+    void insert(int userid, const TcpConnectionPtr &con)
+    {
+        lock_guard<mutex> lock(_mutex);
+        _conns[userid] = con;
+    }
+
+    bool eraseIf(int userid, const TcpConnectionPtr &con)
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto it = _conns.find(userid);
+        if (it == _conns.end() || it->second != con)
+        {
+            return false;
+        }
+        _conns.erase(it);
+        return true;
+    }
+
+    void findMany(const vector<int> &userids, vector<pair<int, TcpConnectionPtr>> &found, vector<int> &missing) const
+    {
+        lock_guard<mutex> lock(_mutex);
+        for (int userid : userids)
+        {
+            auto it = _conns.find(userid);
+            if (it != _conns.end())
+            {
+                found.emplace_back(userid, it->second);
+            }
+            else
+            {
+                missing.push_back(userid);
+            }
+        }
+    }
+
+private:
+    mutable mutex _mutex;
+    unordered_map<int, TcpConnectionPtr> _conns;
+};
+
+// 以numThreads个线程对registry执行opsPerThread次操作, 返回每秒完成的操作数
+template <typename Registry>
+static double run(Registry &registry, int numThreads, int numUsers, int opsPerThread, int groupSize)
+{
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&registry, t, numUsers, opsPerThread, groupSize]()
+        {
+            mt19937 rng(t + 1);
+            uniform_int_distribution<int> user(1, numUsers);
+            vector<int> members(groupSize);
+            vector<pair<int, TcpConnectionPtr>> found;
+            vector<int> missing;
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                if (i % 20 == 0) // 5%的操作是一次断线后重新登录
+                {
+                    int userid = user(rng);
+                    registry.eraseIf(userid, TcpConnectionPtr());
+                    registry.insert(userid, TcpConnectionPtr());
+                    continue;
+                }
+
+                for (int &member : members)
+                {
+                    member = user(rng);
+                }
+                found.clear();
+                missing.clear();
+                registry.findMany(members, found, missing);
+            }
+        });
+    }
+    for (thread &t : threads)
+    {
+        t.join();
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return numThreads * static_cast<double>(opsPerThread) / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    int numUsers = argc > 1 ? atoi(argv[1]) : 200000;
+    int opsPerThread = argc > 2 ? atoi(argv[2]) : 200000;
+    int groupSize = argc > 3 ? atoi(argv[3]) : 20;
+
+    // 连接对象只作为比较和拷贝的值, 不需要真正建立连接, 用空指针代替
+    UserConnRegistry striped;
+    SingleLockRegistry single;
+    for (int userid = 1; userid <= numUsers; ++userid)
+    {
+        striped.insert(userid, TcpConnectionPtr());
+        single.insert(userid, TcpConnectionPtr());
+    }
+
+    cout << "users " << numUsers << ", ops/thread " << opsPerThread << ", group size " << groupSize << endl;
+    cout << "threads\tsingle-lock ops/s\tstriped ops/s\tspeedup" << endl;
+    int maxThreads = max(2u, thread::hardware_concurrency());
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+    {
+        double singleOps = run(single, numThreads, numUsers, opsPerThread, groupSize);
+        double stripedOps = run(striped, numThreads, numUsers, opsPerThread, groupSize);
+        cout << numThreads << "\t" << static_cast<int64_t>(singleOps) << "\t\t" << static_cast<int64_t>(stripedOps)
+             << "\t\t" << stripedOps / singleOps << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include "binaryproto.hpp"
+
+#include <iostream>
+#include <string>
+using namespace std;
+
+// 二进制聊天消息协议(binaryproto.hpp)的测试, 只依赖头文件
+// 失败的检查输出所在行号, 有失败时返回非0
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                                    \
+    do                                                                                 \
+    {                                                                                  \
+        if (!(cond))                                                                   \
+        {                                                                              \
+            cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << endl;    \
+            ++g_failures;                                                              \
+        }                                                                              \
+    } while (0)
+
+// 编码后再解码, 所有字段保持不变
+void testRoundTrip()
+{
+    ChatMessage m;
+    m.msgId = ONE_CHAT_MSG;
+    m.fromid = 13;
+    m.toid = -2; // 负数按int32传输
+    m.groupid = 0x7FFFFFFF;
+    m.time = 1700000000;
+    m.name = "张三";
+    m.msg = string("hello\0world", 11); // 消息体中间可以有0字节
+
+    string frame = encodeBinaryMsg(m);
+    CHECK(frame.size() == BINARY_MSG_HEADER_LEN + m.name.size() + m.msg.size());
+    CHECK(isBinaryMsg(frame));
+
+    ChatMessage d;
+    CHECK(decodeBinaryMsg(frame, d));
+    CHECK(d.msgId == m.msgId);
+    CHECK(d.fromid == m.fromid);
+    CHECK(d.toid == m.toid);
+    CHECK(d.groupid == m.groupid);
+    CHECK(d.time == m.time);
+    CHECK(d.name == m.name);
+    CHECK(d.msg == m.msg);
+}
+
+// 用户名和消息体都为空时, 帧只有固定头部, 且以0字节结尾
+void testEmptyNameAndBody()
+{
+    ChatMessage m;
+    m.msgId = GROUP_CHAT_MSG;
+    m.fromid = 1;
+    m.groupid = 2;
+
+    string frame = encodeBinaryMsg(m);
+    CHECK(frame.size() == BINARY_MSG_HEADER_LEN);
+    CHECK(frame.back() == '\0');
+
+    ChatMessage d;
+    CHECK(decodeBinaryMsg(frame, d));
+    CHECK(d.groupid == 2);
+    CHECK(d.name.empty());
+    CHECK(d.msg.empty());
+}
+
+// 格式不合法的帧解码失败
+void testInvalidFrames()
+{
+    ChatMessage m;
+    m.msgId = ONE_CHAT_MSG;
+    m.name = "abc";
+    m.msg = "hi";
+    string frame = encodeBinaryMsg(m);
+    ChatMessage d;
+
+    CHECK(!decodeBinaryMsg("", d));
+    CHECK(!decodeBinaryMsg(frame.substr(0, BINARY_MSG_HEADER_LEN - 1), d)); // 头部不完整
+    CHECK(!decodeBinaryMsg(frame.substr(0, BINARY_MSG_HEADER_LEN + 2), d)); // 用户名不完整
+
+    string badMagic = frame;
+    badMagic[0] = '{';
+    CHECK(!isBinaryMsg(badMagic));
+    CHECK(!decodeBinaryMsg(badMagic, d));
+
+    string badVersion = frame;
+    badVersion[1] = static_cast<char>(BINARY_MSG_VERSION + 1);
+    CHECK(!decodeBinaryMsg(badVersion, d));
+
+    CHECK(!isBinaryMsg(""));
+    CHECK(!isBinaryMsg("{\"msgId\":6}"));
+}
+
+// 用户名超过namelen字段的上限时不能编码成二进制格式, 返回空串, 不会截断长度
+void testNameTooLong()
+{
+    ChatMessage m;
+    m.msgId = ONE_CHAT_MSG;
+    m.toid = 2;
+    m.msg = "hi";
+
+    m.name = string(BINARY_MSG_MAX_NAME_LEN, 'n');
+    string frame = encodeBinaryMsg(m);
+    ChatMessage d;
+    CHECK(decodeBinaryMsg(frame, d) && d.name == m.name && d.msg == "hi");
+
+    m.name.push_back('n');
+    CHECK(encodeBinaryMsg(m).empty());
+}
+
+// json => ChatMessage: 字段缺失或类型不对时取默认值, 不抛出异常
+void testFromJson()
+{
+    json js = json::parse(R"({"msgId":6,"id":1,"toid":2,"name":"li","msg":"hi","time":"2024-01-02 03:04:05"})");
+    ChatMessage m = chatMessageFromJson(js);
+    CHECK(m.msgId == ONE_CHAT_MSG);
+    CHECK(m.fromid == 1);
+    CHECK(m.toid == 2);
+    CHECK(m.name == "li");
+    CHECK(m.msg == "hi");
+    CHECK(m.time == parseChatTime("2024-01-02 03:04:05"));
+
+    try
+    {
+        ChatMessage bad = chatMessageFromJson(json::parse(R"({"msgId":6,"id":"1","toid":2.5,"msg":123,"name":null,"time":7})"));
+        CHECK(bad.msgId == ONE_CHAT_MSG);
+        CHECK(bad.fromid == 0);
+        CHECK(bad.toid == 0);
+        CHECK(bad.msg.empty());
+        CHECK(bad.name.empty());
+        CHECK(bad.time == 0);
+
+        ChatMessage notObject = chatMessageFromJson(json::parse("[1,2,3]"));
+        CHECK(notObject.msgId == 0);
+    }
+    catch (const exception &e)
+    {
+        cerr << "chatMessageFromJson threw: " << e.what() << endl;
+        ++g_failures;
+    }
+}
+
+// ChatMessage => json: 一对一聊天带toid, 群聊带groupid
+void testToJson()
+{
+    ChatMessage m;
+    m.msgId = ONE_CHAT_MSG;
+    m.fromid = 1;
+    m.toid = 2;
+    m.groupid = 3;
+    m.name = "li";
+    m.msg = "hi";
+    m.time = parseChatTime("2024-01-02 03:04:05");
+
+    json one = chatMessageToJson(m);
+    CHECK(one["toid"] == 2);
+    CHECK(!one.contains("groupid"));
+    CHECK(one["time"] == "2024-01-02 03:04:05");
+
+    m.msgId = GROUP_CHAT_MSG;
+    json group = chatMessageToJson(m);
+    CHECK(group["groupid"] == 3);
+    CHECK(!group.contains("toid"));
+
+    // json和二进制之间来回转换, 字段保持不变
+    ChatMessage back = chatMessageFromJson(group);
+    CHECK(back.fromid == m.fromid);
+    CHECK(back.groupid == m.groupid);
+    CHECK(back.time == m.time);
+    CHECK(back.msg == m.msg);
+}
+
+// 时间格式转换
+void testChatTime()
+{
+    CHECK(formatChatTime(parseChatTime("2023-12-31 23:59:59")) == "2023-12-31 23:59:59");
+    CHECK(parseChatTime("") == 0);
+    CHECK(parseChatTime("not a time") == 0);
+}
+
+int main()
+{
+    testRoundTrip();
+    testEmptyNameAndBody();
+    testInvalidFrames();
+    testNameTooLong();
+    testFromJson();
+    testToJson();
+    testChatTime();
+
+    if (g_failures != 0)
+    {
+        cerr << g_failures << " check(s) failed" << endl;
+        return 1;
+    }
+    cout << "testbinaryproto passed" << endl;
+    return 0;
+}
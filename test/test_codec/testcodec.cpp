@@ -0,0 +1,160 @@
+#include "chatcodec.hpp"
+#include "binaryproto.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// 消息帧编解码器(ChatCodec::encode/decode)的测试, 只用到muduo的Buffer, 不需要建立连接
+// 失败的检查输出所在行号, 有失败时返回非0
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                                    \
+    do                                                                                 \
+    {                                                                                  \
+        if (!(cond))                                                                   \
+        {                                                                              \
+            cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << endl;    \
+            ++g_failures;                                                              \
+        }                                                                              \
+    } while (0)
+
+// 取出buffer中所有完整的帧, 返回最后一次decode的结果
+static ChatCodec::DecodeResult decodeAll(Buffer *buffer, vector<string> &frames, size_t maxFrameLen = ChatCodec::kMaxFrameLen)
+{
+    FramePtr frame;
+    ChatCodec::DecodeResult result;
+    while ((result = ChatCodec::decode(buffer, maxFrameLen, frame)) == ChatCodec::kFrameReady)
+    {
+        frames.push_back(*frame);
+    }
+    return result;
+}
+
+// 单个帧编码后再解码, 内容不变, buffer被取空
+void testRoundTrip()
+{
+    Buffer buffer;
+    ChatCodec::encode("{\"msgId\":1}", &buffer);
+    CHECK(buffer.readableBytes() == ChatCodec::kHeaderLen + 11);
+
+    vector<string> frames;
+    CHECK(decodeAll(&buffer, frames) == ChatCodec::kFrameIncomplete);
+    CHECK(frames.size() == 1 && frames[0] == "{\"msgId\":1}");
+    CHECK(buffer.readableBytes() == 0);
+}
+
+// 一次收到多个帧(粘包), 依次取出
+void testMultipleFrames()
+{
+    Buffer buffer;
+    ChatCodec::encode("a", &buffer);
+    ChatCodec::encode("", &buffer); // 空帧也是合法的帧
+    ChatCodec::encode("ccc", &buffer);
+
+    vector<string> frames;
+    decodeAll(&buffer, frames);
+    CHECK(frames.size() == 3);
+    CHECK(frames.size() == 3 && frames[0] == "a" && frames[1].empty() && frames[2] == "ccc");
+}
+
+// 长度头和消息体分多次到达(半包), 收齐之前不取出
+void testPartialFrame()
+{
+    Buffer encoded;
+    ChatCodec::encode("hello", &encoded);
+    string bytes = encoded.retrieveAllAsString();
+
+    Buffer buffer;
+    vector<string> frames;
+    for (size_t i = 0; i < bytes.size(); ++i)
+    {
+        CHECK(frames.empty());
+        buffer.append(bytes.data() + i, 1);
+        decodeAll(&buffer, frames);
+    }
+    CHECK(frames.size() == 1 && frames[0] == "hello");
+}
+
+// 长度为负数或超过上限的帧是非法的, 数据留在buffer中
+void testInvalidLength()
+{
+    Buffer negative;
+    negative.appendInt32(-1);
+    vector<string> frames;
+    CHECK(decodeAll(&negative, frames) == ChatCodec::kFrameInvalid);
+    CHECK(frames.empty());
+
+    Buffer tooLong;
+    ChatCodec::encode(string(17, 'x'), &tooLong);
+    CHECK(decodeAll(&tooLong, frames, 16) == ChatCodec::kFrameInvalid);
+    CHECK(frames.empty());
+
+    Buffer atLimit;
+    ChatCodec::encode(string(16, 'x'), &atLimit);
+    CHECK(decodeAll(&atLimit, frames, 16) == ChatCodec::kFrameIncomplete);
+    CHECK(frames.size() == 1 && frames[0].size() == 16);
+}
+
+// 旧客户端在json消息末尾多发送的'\0'被去掉
+void testJsonTrailingZero()
+{
+    Buffer buffer;
+    ChatCodec::encode(string("{\"msgId\":1}\0\0", 13), &buffer);
+    ChatCodec::encode(string("\0", 1), &buffer);
+
+    vector<string> frames;
+    decodeAll(&buffer, frames);
+    CHECK(frames.size() == 2);
+    CHECK(frames.size() == 2 && frames[0] == "{\"msgId\":1}" && frames[1].empty());
+}
+
+// 二进制消息末尾的0字节是头部字段或消息内容, 原样保留
+void testBinaryTrailingZero()
+{
+    ChatMessage empty; // 用户名和消息体都为空, 帧以reserved字段的0字节结尾
+    empty.msgId = ONE_CHAT_MSG;
+    empty.fromid = 1;
+    empty.toid = 2;
+
+    ChatMessage zeroBody = empty;
+    zeroBody.name = "li";
+    zeroBody.msg = string("hi\0\0", 4);
+
+    Buffer buffer;
+    ChatCodec::encode(encodeBinaryMsg(empty), &buffer);
+    ChatCodec::encode(encodeBinaryMsg(zeroBody), &buffer);
+
+    vector<string> frames;
+    decodeAll(&buffer, frames);
+    CHECK(frames.size() == 2);
+    if (frames.size() != 2)
+    {
+        return;
+    }
+
+    ChatMessage d;
+    CHECK(frames[0].size() == BINARY_MSG_HEADER_LEN);
+    CHECK(decodeBinaryMsg(frames[0], d) && d.toid == 2 && d.msg.empty());
+    CHECK(decodeBinaryMsg(frames[1], d) && d.name == "li" && d.msg == zeroBody.msg);
+}
+
+int main()
+{
+    testRoundTrip();
+    testMultipleFrames();
+    testPartialFrame();
+    testInvalidLength();
+    testJsonTrailingZero();
+    testBinaryTrailingZero();
+
+    if (g_failures != 0)
+    {
+        cerr << g_failures << " check(s) failed" << endl;
+        return 1;
+    }
+    cout << "testcodec passed" << endl;
+    return 0;
+}